@@ -235,15 +235,21 @@ typedef int BOOL;
 /*                                                              */
 /* Common byte, 16 bit and 32 bit types                         */
 /*                                                              */
+#if defined(__GNUC__) && defined(__LP64__)
+#define LONG32 int              /* 64 bit host, long is too wide */
+#else
+#define LONG32 long
+#endif
+
 #ifndef _WIN32
 typedef char BYTE;
 typedef short WORD;
-typedef long DWORD;
+typedef LONG32 DWORD;
 #endif
 
 typedef unsigned char UBYTE;
 typedef unsigned short UWORD;
-typedef unsigned long UDWORD;
+typedef unsigned LONG32 UDWORD;
 
 typedef short SHORT;
 
@@ -251,10 +257,10 @@ typedef unsigned int BITS;      /* for use in bit fields(!)     */
 
 typedef int COUNT;
 typedef unsigned int UCOUNT;
-typedef unsigned long ULONG;
+typedef unsigned LONG32 ULONG;
 
 #ifdef WITHFAT32
-typedef unsigned long CLUSTER;
+typedef unsigned LONG32 CLUSTER;
 #else
 typedef unsigned short CLUSTER;
 #endif
@@ -275,9 +281,9 @@ typedef void FAR *ADDRESS;
 #endif
 
 #ifdef STRICT
-typedef signed long LONG;
+typedef signed LONG32 LONG;
 #else
-#define LONG long
+#define LONG LONG32
 #endif
 
 typedef UWORD ofs_t;
@@ -0,0 +1,528 @@
+/***************************************************************
+
+                                    bench.c   
+                                    DOS-C
+
+                            sys utility for DOS-C
+
+                             Copyright (c) 1991
+                             Pasquale J. Villani
+                             All Rights Reserved
+
+ This file is part of DOS-C.
+
+ DOS-C is free software; you can redistribute it and/or modify it under the
+ terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ DOS-C is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ details.
+
+ You should have received a copy of the GNU General Public License along with
+ DOS-C; see the file COPYING.  If not, write to the Free Software Foundation,
+ 675 Mass Ave, Cambridge, MA 02139, USA.
+
+***************************************************************/
+
+/* copy throughput benchmark, built and run on the host (see GNUmakefile):
+     bench [-d dir] [-n iterations] [-s strategy] [-c chunk]
+   Synthetic source files are created in dir/src and copied with copy()
+   to a drive mapped to dir/dst, for each combination of file size,
+   buffering strategy, and chunk (buffer) size.  Results are written to
+   stdout as a tab separated table, one row per combination:
+     strategy chunk size iterations usec_per_copy kb_per_sec ok
+   followed by rows for CRC-32 and huge buffer moves, then for reading
+   64K to 512K files into a far buffer and writing them back out (hugeio
+   uses hugeRead/hugeWrite, byteloop the per byte normalizePtr() loop
+   copy() used before, chunk is bytes per read or write), then for scanning
+   synthetic FAT12/16/32 FATs of 4K to 4M entries for free space (chunk
+   is entries; fast is the normal scan, scalar looks at every entry and
+   fast rows are ok only if both find the same).  Strategies are
+     simple   - one buffer, read then write (low memory loop)
+     pingpong - COPY_BUFFERS buffers filled then drained
+     whole    - one buffer sized to the file (chunk ignored)
+     cached   - file read into memory first, as when installing to
+                several drives, then written in one go (chunk ignored)
+*/
+
+#include "sys.h"
+#include "diskio.h"
+#include "fatio.h"
+#include <time.h>
+
+BYTE pgm[] = "SYS";
+
+#define BENCH_DRIVE 2           /* destination drive letter used, C: */
+#define MAX_PATH_LEN 200
+
+/* 1KB to 1MB, plus sizes either side of copy buffer and run boundaries */
+static ULONG sizes[] = {
+  0x400, 0x1000, 0x4000, 0x10000, 0x40000, 0x100000,
+  COPY_SIZE - 1, COPY_SIZE + 1, 2 * COPY_SIZE - 1, 2 * COPY_SIZE + 1,
+  HUGE_CHUNK - 1, HUGE_CHUNK + 1, 0x10000UL + SEC_SIZE - 1
+};
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static ULONG chunks[] = { SEC_SIZE, 0x1000, COPY_SIZE, 0x10000UL, 0 };
+#define NCHUNKS (sizeof(chunks) / sizeof(chunks[0]))
+
+typedef enum { SIMPLE, PINGPONG, WHOLE, CACHED, NSTRATEGIES } Strategy;
+static const char *strategyNames[NSTRATEGIES] = { "simple", "pingpong", "whole", "cached" };
+
+/* file sizes for huge buffer transfers against the old per byte loop */
+static ULONG hugeSizes[] = { 0x10000UL, 0x20000UL, 0x80000UL };
+#define NHUGESIZES (sizeof(hugeSizes) / sizeof(hugeSizes[0]))
+
+static char workDir[MAX_PATH_LEN] = "benchtmp";
+static int iterations = 10;
+static int quietFd = -1, stdoutFd = -1;
+
+
+/* microseconds from an arbitrary starting point */
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* hide (or restore) messages copy() displays while it is being timed */
+static void quiet(BOOL on)
+{
+  fflush(stdout);
+  if (on)
+  {
+    if (quietFd < 0)
+    {
+      quietFd = open("/dev/null", O_WRONLY);
+      stdoutFd = dup(1);
+    }
+    dup2(quietFd, 1);
+  }
+  else
+    dup2(stdoutFd, 1);
+}
+
+/* creates source file of size bytes filled with pseudo random data,
+   returns its CRC-32 */
+static ULONG makeSource(const char *name, ULONG size)
+{
+  static BYTE block[0x1000];
+  ULONG seed = size, done, crc = 0;
+  unsigned i, n;
+  int fd;
+
+  if ((fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+  {
+    printf("bench: can not create %s\n", name);
+    exit(1);
+  }
+  for (done = 0; done < size; done += n)
+  {
+    n = (size - done > sizeof(block)) ? sizeof(block) : (unsigned)(size - done);
+    for (i = 0; i < n; i++)
+    {
+      seed = seed * 1103515245UL + 12345;
+      block[i] = (BYTE)(seed >> 16);
+    }
+    crc = updateCRC32(crc, block, n);
+    if (write(fd, block, n) != (int)n)
+    {
+      printf("bench: can not write %s\n", name);
+      exit(1);
+    }
+  }
+  close(fd);
+  return crc;
+}
+
+/* returns CRC-32 of file, or ~crc if it is not size bytes long */
+static ULONG fileCRC(const char *name, ULONG size, ULONG expect)
+{
+  static BYTE block[0x10000];
+  ULONG crc = 0, total = 0;
+  int fd, got;
+
+  if ((fd = open(name, O_RDONLY)) < 0)
+    return ~expect;
+  while ((got = read(fd, block, sizeof(block))) > 0)
+  {
+    crc = updateCRC32(crc, block, got);
+    total += got;
+  }
+  close(fd);
+  return (total == size) ? crc : ~expect;
+}
+
+/* times copy() of source of given size, prints one table row */
+static void benchCopy(Strategy s, ULONG chunk, const char *source, ULONG size, ULONG crc)
+{
+  static SYSOptions opts;
+  char dest[SYS_MAXPATH];
+  double start, elapsed = 0;
+  BOOL ok = TRUE;
+  int i;
+
+  opts.spaceChecked = TRUE;     /* checked once in main() */
+  copyBufferCount = (s == PINGPONG) ? COPY_BUFFERS : 1;
+  copyChunkSize = (s == WHOLE || s == CACHED) ? 0 : chunk;
+
+  for (i = 0; i < iterations && ok; i++)
+  {
+    quiet(TRUE);
+    start = now();
+    if (s == CACHED)
+      cacheSource(source);
+    ok = copy(source, BENCH_DRIVE, "BENCH.DAT", &opts);
+    if (s == CACHED)
+      freeSources();
+    elapsed += now() - start;
+    quiet(FALSE);
+  }
+
+  destPath(dest, BENCH_DRIVE, "BENCH.DAT");
+  ok = ok && fileCRC(dest, size, crc) == crc;
+  unlink(dest);
+
+  elapsed /= iterations;
+  printf("%s\t%lu\t%lu\t%d\t%.1f\t%.0f\t%s\n", strategyNames[s],
+         (unsigned long)chunk, (unsigned long)size,
+         iterations, elapsed, elapsed > 0 ? size / 1.024 / elapsed * 1000 : 0.0,
+         ok ? "ok" : "FAILED");
+}
+
+/* CRC-32 and huge buffer moves over a 1MB buffer */
+static void benchMemory(void)
+{
+  ULONG size = 0x100000UL, crc = 0;
+  BYTE FAR *a = allocBlock(size), FAR *b = allocBlock(size);
+  double start, elapsed;
+  int i;
+
+  if (a == NULL || b == NULL)
+    return;
+  memset(a, 0x5A, (size_t)size);
+
+  start = now();
+  for (i = 0; i < iterations; i++)
+    crc = updateCRC32(crc, a, size);
+  elapsed = (now() - start) / iterations;
+  printf("crc32\t%lu\t%lu\t%d\t%.1f\t%.0f\t%s\n", 0UL, (unsigned long)size, iterations,
+         elapsed, elapsed > 0 ? size / 1.024 / elapsed * 1000 : 0.0, crc ? "ok" : "FAILED");
+
+  start = now();
+  for (i = 0; i < iterations; i++)
+    hugeMove(b, a, size);
+  elapsed = (now() - start) / iterations;
+  printf("hugemove\t%lu\t%lu\t%d\t%.1f\t%.0f\t%s\n",
+         (unsigned long)HUGE_CHUNK, (unsigned long)size, iterations,
+         elapsed, elapsed > 0 ? size / 1.024 / elapsed * 1000 : 0.0,
+         memcmp(a, b, (size_t)size) == 0 ? "ok" : "FAILED");
+
+  freeBlock(b);
+  freeBlock(a);
+}
+
+/* times taken by renormalizing, so the per byte check is not optimized away */
+static ULONG renormalized;
+
+/* as copy() used to after every byte, though flat host pointers are
+   only counted where DOS moved the offset into the segment */
+static void normalizePtr(BYTE FAR **ptr)
+{
+  if (((size_t)*ptr & 0xFFFF) > 0x7777)
+    renormalized++;
+}
+
+/* reads source into buf then writes it to dest, one byte at a time
+   through a COPY_SIZE buffer (byteLoop) or with hugeRead/hugeWrite,
+   returns FALSE on error */
+static BOOL hugeTransfer(const char *source, const char *dest, BYTE FAR *buf,
+                         ULONG size, BOOL byteLoop)
+{
+  static BYTE copybuffer[COPY_SIZE];
+  BYTE FAR *bufptr = buf;
+  ULONG copied;
+  unsigned offs, chunk;
+  int fdin, fdout, ret;
+
+  if ((fdin = open(source, O_RDONLY | O_BINARY)) < 0)
+    return FALSE;
+  if (!byteLoop)
+    copied = hugeRead(fdin, buf, size);
+  else
+  {
+    for (copied = 0; (ret = read(fdin, copybuffer, COPY_SIZE)) > 0; copied += ret)
+    {
+      for (offs = 0; offs < (unsigned)ret; offs++)
+      {
+        *bufptr = copybuffer[offs];
+        bufptr++;
+        normalizePtr(&bufptr);
+      }
+    }
+  }
+  close(fdin);
+  if (copied != size)
+    return FALSE;
+
+  if ((fdout = open(dest, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644)) < 0)
+    return FALSE;
+  if (!byteLoop)
+    copied = hugeWrite(fdout, buf, size);
+  else
+  {
+    bufptr = buf;
+    for (copied = 0; copied < size; copied += chunk)
+    {
+      chunk = (size - copied > COPY_SIZE) ? COPY_SIZE : (unsigned)(size - copied);
+      for (offs = 0; offs < chunk; offs++)
+      {
+        copybuffer[offs] = *bufptr;
+        bufptr++;
+        normalizePtr(&bufptr);
+      }
+      if ((unsigned)write(fdout, copybuffer, chunk) != chunk)
+        break;
+    }
+  }
+  close(fdout);
+  return copied == size;
+}
+
+/* file to huge buffer and back, hugeRead/hugeWrite against per byte loop */
+static void benchHuge(const char *srcDir)
+{
+  char source[SYS_MAXPATH], dest[SYS_MAXPATH];
+  BYTE FAR *buf = allocBlock(hugeSizes[NHUGESIZES - 1]);
+  double start, elapsed;
+  unsigned i;
+  int byteLoop, n;
+
+  if (buf == NULL)
+    return;
+  destPath(dest, BENCH_DRIVE, "BENCH.DAT");
+  for (i = 0; i < NHUGESIZES; i++)
+  {
+    ULONG size = hugeSizes[i], crc;
+
+    sprintf(source, "%s/HUGE%05lX.DAT", srcDir, (unsigned long)size);
+    crc = makeSource(source, size);
+    for (byteLoop = 0; byteLoop < 2; byteLoop++)
+    {
+      BOOL ok = TRUE;
+
+      start = now();
+      for (n = 0; n < iterations && ok; n++)
+        ok = hugeTransfer(source, dest, buf, size, byteLoop);
+      elapsed = (now() - start) / iterations;
+      ok = ok && fileCRC(dest, size, crc) == crc;
+      unlink(dest);
+      printf("%s\t%lu\t%lu\t%d\t%.1f\t%.0f\t%s\n", byteLoop ? "byteloop" : "hugeio",
+             byteLoop ? (unsigned long)COPY_SIZE : (unsigned long)HUGE_CHUNK,
+             (unsigned long)size, iterations,
+             elapsed, elapsed > 0 ? size / 1.024 / elapsed * 1000 : 0.0,
+             ok ? "ok" : "FAILED");
+    }
+    unlink(source);
+  }
+  freeBlock(buf);
+}
+
+/* fills FAT of entries entries with runs of free and used clusters */
+static void makeFAT(FileSystem fs, UBYTE *fat, ULONG entries)
+{
+  ULONG n, value, seed = 12345, run = 0;
+  BOOL used = TRUE;
+
+  for (n = 0; n < entries; n++)
+  {
+    if (!run)
+    {
+      /* mostly short runs with the occasional long one, like a used disk */
+      seed = seed * 1103515245UL + 12345;
+      run = 1 + ((seed >> 16) & ((seed & 0x100) ? 0x3FF : 0x1F));
+      used = !used;
+    }
+    run--;
+    value = used ? (run ? n + 1 : LONG_LAST_CLUSTER) : FREE;
+    if (fs == FAT12)
+    {
+      value &= 0xFFF;
+      if (n & 1)
+      {
+        fat[n / 2 * 3 + 1] |= (UBYTE)(value << 4);
+        fat[n / 2 * 3 + 2] = (UBYTE)(value >> 4);
+      }
+      else
+      {
+        fat[n / 2 * 3] = (UBYTE)value;
+        fat[n / 2 * 3 + 1] = (UBYTE)(value >> 8);
+      }
+    }
+    else if (fs == FAT16)
+    {
+      fat[n * 2] = (UBYTE)value;
+      fat[n * 2 + 1] = (UBYTE)(value >> 8);
+    }
+    else
+    {
+      fat[n * 4] = (UBYTE)value;
+      fat[n * 4 + 1] = (UBYTE)(value >> 8);
+      fat[n * 4 + 2] = (UBYTE)(value >> 16);
+      fat[n * 4 + 3] = (UBYTE)(value >> 24);
+    }
+  }
+}
+
+#define SCAN_EXTENTS 64
+
+/* times scan of FAT in mode, results in scan with 1st extents found */
+static double timeScan(FileSystem fs, UBYTE *fat, ULONG entries, int mode,
+                       FreeScan *scan, FreeExtent *extents)
+{
+  double start = now();
+  int i;
+
+  fatScanMode = mode;
+  for (i = 0; i < iterations; i++)
+  {
+    startScan(scan, 0, extents, SCAN_EXTENTS);
+    scanFATBlock(fs, fat, 0, entries, scan);
+    finishScan(scan);
+  }
+  fatScanMode = SCAN_FAST;
+  return (now() - start) / iterations;
+}
+
+/* free space scans of synthetic FATs, fast against scalar */
+static void benchFATScan(void)
+{
+  static const FileSystem types[] = { FAT12, FAT16, FAT32 };
+  static const char *names[] = { "fat12", "fat16", "fat32" };
+  ULONG entries, bytes;
+  static FreeExtent fastExtents[SCAN_EXTENTS], scalarExtents[SCAN_EXTENTS];
+  FreeScan fast, scalar;
+  unsigned listed;
+  double elapsed[2];
+  UBYTE *fat;
+  unsigned t;
+  int m;
+
+  for (t = 0; t < 3; t++)
+  {
+    for (entries = 0x1000; entries <= 0x400000UL; entries <<= 2)
+    {
+      bytes = (types[t] == FAT12) ? entries / 2 * 3 :
+              entries * ((types[t] == FAT16) ? SIZEOF_CLST16 : SIZEOF_CLST32);
+      if ((fat = calloc(1, (size_t)bytes)) == NULL)
+        return;
+      makeFAT(types[t], fat, entries);
+      elapsed[0] = timeScan(types[t], fat, entries, SCAN_FAST, &fast, fastExtents);
+      elapsed[1] = timeScan(types[t], fat, entries, SCAN_SCALAR, &scalar, scalarExtents);
+      listed = (fast.extentCount < SCAN_EXTENTS) ? (unsigned)fast.extentCount : SCAN_EXTENTS;
+      for (m = 0; m < 2; m++)
+        printf("%s%s\t%lu\t%lu\t%d\t%.1f\t%.0f\t%s\n", names[t], m ? "scalar" : "fast",
+               (unsigned long)entries, (unsigned long)bytes, iterations, elapsed[m],
+               elapsed[m] > 0 ? bytes / 1.024 / elapsed[m] * 1000 : 0.0,
+               (fast.freeCount == scalar.freeCount && fast.firstFree == scalar.firstFree &&
+                fast.extentCount == scalar.extentCount &&
+                fast.longest.start == scalar.longest.start &&
+                fast.longest.length == scalar.longest.length &&
+                memcmp(fastExtents, scalarExtents, listed * sizeof(FreeExtent)) == 0)
+               ? "ok" : "FAILED");
+      free(fat);
+    }
+  }
+}
+
+static void usage(void)
+{
+  printf("usage: bench [-d dir] [-n iterations] [-s strategy] [-c chunk]\n"
+         "  strategy is simple, pingpong, whole, or cached; chunk is in bytes,\n"
+         "  0 to size buffers by available memory.  Default is all of each.\n");
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  char srcDir[MAX_PATH_LEN + 8], dstDir[MAX_PATH_LEN + 8], source[SYS_MAXPATH];
+  int onlyStrategy = -1, s, opt;
+  long onlyChunk = -1;
+  unsigned i, c;
+
+  while ((opt = getopt(argc, argv, "d:n:s:c:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'd':
+        strncpy(workDir, optarg, sizeof(workDir) - 1);
+        break;
+      case 'n':
+        if ((iterations = atoi(optarg)) < 1)
+          usage();
+        break;
+      case 's':
+        for (onlyStrategy = 0; onlyStrategy < NSTRATEGIES; onlyStrategy++)
+          if (strcmp(optarg, strategyNames[onlyStrategy]) == 0)
+            break;
+        if (onlyStrategy == NSTRATEGIES)
+          usage();
+        break;
+      case 'c':
+        onlyChunk = strtol(optarg, NULL, 0);
+        break;
+      default:
+        usage();
+    }
+  }
+
+  sprintf(srcDir, "%s/src", workDir);
+  sprintf(dstDir, "%s/dst", workDir);
+  mkdir(workDir, 0755);
+  mkdir(srcDir, 0755);
+  mkdir(dstDir, 0755);
+  setDrivePath(BENCH_DRIVE, dstDir);
+
+  if (!check_space(BENCH_DRIVE, 2 * 0x100000UL))
+  {
+    printf("bench: not enough space in %s\n", dstDir);
+    return 1;
+  }
+
+  printf("# strategy\tchunk\tsize\titerations\tusec\tkb_per_sec\tresult\n");
+  for (i = 0; i < NSIZES; i++)
+  {
+    ULONG crc;
+
+    sprintf(source, "%s/SRC%05lX.DAT", srcDir, (unsigned long)sizes[i]);
+    crc = makeSource(source, sizes[i]);
+
+    for (s = 0; s < NSTRATEGIES; s++)
+    {
+      if (onlyStrategy >= 0 && s != onlyStrategy)
+        continue;
+      for (c = 0; c < NCHUNKS; c++)
+      {
+        /* whole file strategies have no chunk size to vary */
+        if ((s == WHOLE || s == CACHED) && chunks[c] != 0)
+          continue;
+        if (onlyChunk >= 0 && chunks[c] != (ULONG)onlyChunk)
+          continue;
+        benchCopy(s, chunks[c], source, sizes[i], crc);
+      }
+    }
+    unlink(source);
+  }
+  benchMemory();
+  benchHuge(srcDir);
+  benchFATScan();
+
+  rmdir(srcDir);
+  rmdir(dstDir);
+  rmdir(workDir);
+  return 0;
+}
@@ -0,0 +1,359 @@
+/***************************************************************
+
+                                    blockio.c
+                                    DOS-C
+
+                            sys utility for DOS-C
+
+                             Copyright (c) 1991
+                             Pasquale J. Villani
+                             All Rights Reserved
+
+ This file is part of DOS-C.
+
+ DOS-C is free software; you can redistribute it and/or modify it under the
+ terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ DOS-C is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ details.
+
+ You should have received a copy of the GNU General Public License along with
+ DOS-C; see the file COPYING.  If not, write to the Free Software Foundation,
+ 675 Mass Ave, Cambridge, MA 02139, USA.
+
+***************************************************************/
+
+/* write-back cache of recently used raw sectors, kept by (drive, sector)
+   and replaced least recently used first.  Writes only update the cache,
+   dirty sectors are written in ascending order when the drive is
+   unlocked or the program exits, with runs of adjacent sectors done as
+   one multi-sector MyAbsReadWrite().  A run is at most MAX_RUN sectors
+   and, if a track size was given, never crosses a track.  Runs of
+   several sectors are staged through a temporary buffer; if it can't be
+   allocated each sector is written alone.  Large transfers (file data)
+   bypass the cache.  It must be invalidated before DOS itself writes to
+   a drive, see invalidateCache().
+
+   Drive access may be grouped with beginDriveAccess()/endDriveAccess()
+   so a sequence of raw accesses locks (and has DOS reset) the drive
+   once; these nest, only the outermost pair locks and unlocks.
+*/
+
+#include "sys.h"
+#include "diskio.h"
+
+#define MAX_RUN    (HUGE_CHUNK / SEC_SIZE)  /* largest single transfer */
+#define CACHE_MAX  64                       /* most sectors cached, 32KB */
+#define CACHE_MIN  8                        /* else no cache is used */
+#define NO_DRIVE   0xFF                     /* drive of unused cache slot */
+
+/* dirty sector to be written, sorted into runs by flushCache() */
+typedef struct {
+  UBYTE drive;
+  ULONG sector;
+  UBYTE FAR *buffer;
+} DirtySector;
+
+static unsigned trackSize[26];              /* per drive, 0 if runs may cross tracks */
+
+ULONG ioRequests = 0;                       /* sectors read or written */
+ULONG ioTransfers = 0;                      /* MyAbsReadWrite calls made */
+
+typedef struct {
+  UBYTE drive;                              /* NO_DRIVE if slot unused */
+  UBYTE dirty;                              /* needs writing to disk */
+  ULONG sector;
+  ULONG lastUse;                            /* for least recently used */
+} CacheSlot;
+
+static CacheSlot slots[CACHE_MAX];
+static UBYTE FAR *cacheData;                /* SEC_SIZE bytes per slot */
+static BOOL cacheReady = FALSE;             /* set once cache allocated */
+static ULONG useCount = 0;
+
+unsigned cacheSectors = 0;                  /* slots in use, 0 if no cache */
+ULONG cacheHits = 0, cacheMisses = 0;       /* sectors read from cache or disk */
+ULONG cacheWrites = 0, cacheWritten = 0;    /* sectors written to cache, disk */
+
+static UBYTE accessDepth[26];               /* nesting of drive access per drive */
+ULONG driveLocks = 0;                       /* times a drive was locked */
+
+#define slotData(slot) (cacheData + (slot) * SEC_SIZE)
+
+static int rawReadWrite(unsigned drive, unsigned count, ULONG sector, void FAR *buffer, int write)
+{
+  ULONG start = getTicks();
+  int rc;
+
+  ioTransfers++;
+  rc = MyAbsReadWrite(drive, count, sector, buffer, write);
+  statDisk(write ? STAT_SECWRITE : STAT_SECREAD, start, drive, sector, count);
+  return rc;
+}
+
+static void flushAtExit(void)
+{
+  flushCache(NO_DRIVE);
+}
+
+/* allocates cache, sized to a quarter of the memory available */
+static void initCache(void)
+{
+  ULONG avail = availBlock() / 4 / SEC_SIZE;
+  unsigned i;
+
+  cacheReady = TRUE;
+  cacheSectors = (avail > CACHE_MAX) ? CACHE_MAX : (unsigned)avail;
+  if (cacheSectors < CACHE_MIN ||
+      (cacheData = (UBYTE FAR *)allocBlock((ULONG)cacheSectors * SEC_SIZE)) == NULL)
+  {
+    cacheSectors = 0;
+    return;
+  }
+  for (i = 0; i < cacheSectors; i++)
+    slots[i].drive = NO_DRIVE;
+  atexit(flushAtExit);
+}
+
+/* returns slot holding sector, -1 if not cached */
+static int findSlot(unsigned drive, ULONG sector)
+{
+  unsigned i;
+
+  for (i = 0; i < cacheSectors; i++)
+    if (slots[i].drive == drive && slots[i].sector == sector)
+      return i;
+  return -1;
+}
+
+/* returns a slot for sector, reusing least recently used one (written
+   out first if dirty); -1 if that could not be written */
+static int newSlot(unsigned drive, ULONG sector)
+{
+  unsigned i, lru = 0;
+
+  for (i = 0; i < cacheSectors; i++)
+  {
+    if (slots[i].drive == NO_DRIVE)
+    {
+      lru = i;
+      break;
+    }
+    if (slots[i].lastUse < slots[lru].lastUse)
+      lru = i;
+  }
+  if (slots[lru].drive != NO_DRIVE && slots[lru].dirty)
+  {
+    cacheWritten++;
+    if (rawReadWrite(slots[lru].drive, 1, slots[lru].sector, slotData(lru), 1) != 0)
+      return -1;
+  }
+  slots[lru].drive = (UBYTE)drive;
+  slots[lru].sector = sector;
+  slots[lru].dirty = 0;
+  slots[lru].lastUse = ++useCount;
+  return lru;
+}
+
+/* transfer not cached, cached copies of its sectors are kept coherent:
+   dropped when written over, or replace what was read if dirty */
+static int directReadWrite(unsigned drive, unsigned count, ULONG sector, UBYTE FAR *buffer, int write)
+{
+  unsigned i;
+  int rc;
+
+  for (i = 0; write && i < cacheSectors; i++)
+    if (slots[i].drive == drive && slots[i].sector - sector < count)
+      slots[i].drive = NO_DRIVE;
+  if ((rc = rawReadWrite(drive, count, sector, buffer, write)) != 0 || write)
+    return rc;
+  for (i = 0; i < cacheSectors; i++)
+    if (slots[i].drive == drive && slots[i].dirty && slots[i].sector - sector < count)
+      hugeMove((BYTE FAR *)buffer + (unsigned)(slots[i].sector - sector) * SEC_SIZE,
+               (BYTE FAR *)slotData(i), SEC_SIZE);
+  return 0;
+}
+
+/* same as MyAbsReadWrite(), but through the sector cache */
+int cacheReadWrite(int drive, int count, ULONG sector, void FAR *buffer, int write)
+{
+  UBYTE FAR *buf = (UBYTE FAR *)buffer;
+  unsigned i, hits = 0;
+  int slot;
+
+  if (!cacheReady)
+    initCache();
+  ioRequests += count;
+  if ((unsigned)count > cacheSectors / 4)
+    return directReadWrite(drive, count, sector, buf, write);
+
+  if (write)
+  {
+    for (i = 0; i < (unsigned)count; i++, buf += SEC_SIZE)
+    {
+      if ((slot = findSlot(drive, sector + i)) < 0 &&
+          (slot = newSlot(drive, sector + i)) < 0)
+        return -1;
+      hugeMove((BYTE FAR *)slotData(slot), (BYTE FAR *)buf, SEC_SIZE);
+      slots[slot].dirty = 1;
+      slots[slot].lastUse = ++useCount;
+      cacheWrites++;
+    }
+    return 0;
+  }
+
+  /* only go to disk if some sector is not cached, then in one transfer */
+  for (i = 0; i < (unsigned)count; i++)
+    if (findSlot(drive, sector + i) >= 0)
+      hits++;
+  if (hits < (unsigned)count)
+  {
+    cacheMisses += count - hits;
+    cacheHits += hits;
+    if (directReadWrite(drive, count, sector, buf, 0) != 0)
+      return -1;
+    for (i = 0; i < (unsigned)count; i++, buf += SEC_SIZE)
+      if (findSlot(drive, sector + i) < 0 && (slot = newSlot(drive, sector + i)) >= 0)
+        hugeMove((BYTE FAR *)slotData(slot), (BYTE FAR *)buf, SEC_SIZE);
+    return 0;
+  }
+  cacheHits += count;
+  for (i = 0; i < (unsigned)count; i++, buf += SEC_SIZE)
+  {
+    slot = findSlot(drive, sector + i);
+    hugeMove((BYTE FAR *)buf, (BYTE FAR *)slotData(slot), SEC_SIZE);
+    slots[slot].lastUse = ++useCount;
+  }
+  return 0;
+}
+
+
+/* limits runs on drive to a single track of sectors sectors, 0 for no limit */
+void cacheTrackSize(unsigned drive, unsigned sectors)
+{
+  trackSize[drive] = sectors;
+}
+
+/* writes a run of count dirty sectors starting with d to disk */
+static BOOL writeRun(DirtySector *d, unsigned count)
+{
+  UBYTE FAR *staging = NULL;
+  unsigned i;
+  BOOL ok = TRUE;
+
+  if (count > 1)
+    staging = (UBYTE FAR *)allocBlock((ULONG)count * SEC_SIZE);
+  if (staging == NULL)
+  {
+    /* single sector, or no memory so write each sector by itself */
+    for (i = 0; i < count; i++, d++)
+      if (rawReadWrite(d->drive, 1, d->sector, d->buffer, 1) != 0)
+        ok = FALSE;
+    return ok;
+  }
+
+  for (i = 0; i < count; i++)
+    hugeMove((BYTE FAR *)staging + i * SEC_SIZE, (BYTE FAR *)d[i].buffer, SEC_SIZE);
+  if (rawReadWrite(d->drive, count, d->sector, staging, 1) != 0)
+    ok = FALSE;
+  freeBlock((BYTE FAR *)staging);
+  return ok;
+}
+
+/* writes sorted dirty sectors, merging adjacent ones into runs */
+static BOOL writeRuns(DirtySector *d, unsigned total)
+{
+  unsigned i, n;
+  BOOL ok = TRUE;
+
+  for (i = 0; i < total; i += n, d += n)
+  {
+    /* extend run while next sector continues it */
+    for (n = 1; i + n < total && n < MAX_RUN; n++)
+    {
+      if (d[n].drive != d->drive || d[n].sector != d->sector + n)
+        break;
+      if (trackSize[d->drive] && (d[n].sector % trackSize[d->drive]) == 0)
+        break;
+    }
+    if (!writeRun(d, n))
+      ok = FALSE;
+  }
+  return ok;
+}
+
+/* writes dirty cached sectors of drive (NO_DRIVE for all) to disk in
+   ascending order, adjacent ones together; FALSE if any write failed */
+BOOL flushCache(unsigned drive)
+{
+  static DirtySector dirty[CACHE_MAX];
+  unsigned i, j, n = 0;
+  BOOL ok;
+
+  for (i = 0; i < cacheSectors; i++)
+  {
+    CacheSlot *s = &slots[i];
+
+    if (s->drive == NO_DRIVE || !s->dirty || (drive != NO_DRIVE && s->drive != drive))
+      continue;
+    s->dirty = 0;
+    for (j = n++; j > 0; j--)
+    {
+      if (dirty[j-1].drive < s->drive ||
+          (dirty[j-1].drive == s->drive && dirty[j-1].sector < s->sector))
+        break;
+      dirty[j] = dirty[j-1];
+    }
+    dirty[j].drive = s->drive;
+    dirty[j].sector = s->sector;
+    dirty[j].buffer = slotData(i);
+  }
+  cacheWritten += n;
+  if ((ok = writeRuns(dirty, n)) == FALSE)
+    printf("%s: failed to write cached sectors to drive %c:\n", pgm,
+           'A' + ((drive == NO_DRIVE) ? dirty[0].drive : drive));
+  return ok;
+}
+
+/* writes out and forgets all sectors cached for drive, needed before
+   DOS (which has its own buffers) changes the drive */
+void invalidateCache(unsigned drive)
+{
+  unsigned i;
+
+  flushCache(drive);
+  for (i = 0; i < cacheSectors; i++)
+    if (slots[i].drive == drive)
+      slots[i].drive = NO_DRIVE;
+}
+
+
+/* starts a group of raw accesses to drive, locking it if not already */
+void beginDriveAccess(unsigned drive)
+{
+  if (accessDepth[drive]++ == 0)
+  {
+    ULONG start = getTicks();
+
+    driveLocks++;
+    lockDrive(drive);
+    statDisk(STAT_LOCK, start, drive, 0, 0);
+  }
+}
+
+/* ends group of accesses, outermost one writes cache out and unlocks */
+void endDriveAccess(unsigned drive)
+{
+  if (accessDepth[drive] && --accessDepth[drive] == 0)
+  {
+    ULONG start;
+
+    flushCache(drive);  /* so unlock time is just the unlock */
+    start = getTicks();
+    unLockDrive(drive);
+    statDisk(STAT_UNLOCK, start, drive, 0, 0);
+  }
+}
@@ -35,6 +35,10 @@
 
 #ifdef _WIN32
 typedef unsigned long FileAttributes;
+#elif defined __unix__
+typedef unsigned FileAttributes;  /* host files have no DOS attributes */
+#define GetFileAttributes(fname) 0
+#define SetFileAttributes(fname, attr) ((void)(attr))
 #else
 typedef unsigned FileAttributes;
 static unsigned GetFileAttributes(const char *filename)
@@ -143,7 +147,7 @@ void getNtldrConfig(char *buffer, const char *bsFilename, unsigned drive)
 
 static const char *grubFormatDrive(unsigned drive)
 {
-  static char disk[8];
+  static char disk[16];  /* hd or fd and any unsigned number */
   if (drive >= 'C')
     sprintf(disk, "hd%u", (drive-'C'));
   else
@@ -264,6 +268,9 @@ BOOL writeBootLoaderEntry(SYSOptions *opts)
         fn = getGrub2Config;
         break;
       }
+      break;
+    default:  /* NONE, no entry wanted */
+      break;
   }
   if (fn != NULL)
   {
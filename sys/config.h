@@ -12,3 +12,7 @@
 #define WITHOEMCOMPATBS
 /* include support to add entry to existing boot manager */
 #define USEBOOTMANAGER
+/* include support to write kernel files contiguously */
+#define WITHCONTIG
+/* include support for /STATS and /TRACE disk I/O statistics */
+#define WITHSTATS
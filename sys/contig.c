@@ -0,0 +1,514 @@
+/***************************************************************
+
+                                    contig.c
+                                    DOS-C
+
+                            sys utility for DOS-C
+
+                             Copyright (c) 1991
+                             Pasquale J. Villani
+                             All Rights Reserved
+
+ This file is part of DOS-C.
+
+ DOS-C is free software; you can redistribute it and/or modify it under the
+ terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ DOS-C is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ details.
+
+ You should have received a copy of the GNU General Public License along with
+ DOS-C; see the file COPYING.  If not, write to the Free Software Foundation,
+ 675 Mass Ave, Cambridge, MA 02139, USA.
+
+***************************************************************/
+
+/* writes system files to a single run of clusters using raw sector access,
+   so the boot sector can load the kernel with few large sequential reads;
+   also moves system files already on the drive into a single run (/DEFRAG)
+*/
+
+#include "sys.h"
+
+#ifdef WITHCONTIG
+
+#include "diskio.h"
+#include "fatio.h"
+
+#if defined _WIN32 || defined __unix__
+#include <time.h>
+#endif
+
+/* sectors per transfer, whole 4KB blocks as hosts doing direct I/O prefer */
+#define CONTIG_SECTORS  ((HUGE_CHUNK / SEC_SIZE) & ~7)
+
+/* drives copy() can not write to (images) take any free clusters instead */
+#ifdef __unix__
+#define noFallback(drive) isImageDrive(drive)
+#else
+#define noFallback(drive) FALSE
+#endif
+
+
+/* get file's date and time in directory entry format */
+static void getDirTime(int fd, UWORD *date, UWORD *time)
+{
+#if defined _WIN32 || defined __unix__
+  struct stat fstatbuf;
+  struct tm *t;
+
+  *date = *time = 0;
+  if (fstat(fd, &fstatbuf) == 0 && (t = localtime(&fstatbuf.st_mtime)) != NULL)
+  {
+    *date = (UWORD)(((t->tm_year - 80) << 9) | ((t->tm_mon + 1) << 5) | t->tm_mday);
+    *time = (UWORD)((t->tm_hour << 11) | (t->tm_min << 5) | (t->tm_sec / 2));
+  }
+#elif defined __TURBOC__
+  struct ftime ft;  /* bit fields laid out as time word then date word */
+
+  getftime(fd, &ft);
+  *time = ((UWORD *)&ft)[0];
+  *date = ((UWORD *)&ft)[1];
+#else
+#if defined(__WATCOMC__) && __WATCOMC__ < 1280
+  unsigned short d, t;
+#else
+  unsigned d, t;
+#endif
+
+  _dos_getftime(fd, &d, &t);
+  *date = d;
+  *time = t;
+#endif
+}
+
+
+/* copies file (path+filename specified by source) to drive:\filename,
+   placing it in a single run of free clusters; returns FALSE if this is
+   not possible (nothing on disk changed) so caller can use copy() instead.
+   Images, where there is no copy() to fall back on, get whichever
+   clusters are free when no single run is large enough.
+*/
+BOOL copyContig(const BYTE *source, COUNT drive, const BYTE *filename, SYSOptions *opts)
+{
+  static BYTE src[SYS_MAXPATH];
+  static BYTE dest[SYS_MAXPATH];
+  static FATVolume vol;
+  struct dirent entry;
+  DirSlot found, unused;
+  ULONG filesize, clusterSize, count, start = 0, cluster, sector, done, oldStart = 0;
+  ULONG ticks, crc = 0, oldSize = 0, linked;
+  BYTE FAR *buffer = NULL;
+  BYTE FAR *cache;
+  unsigned bufSectors, n, left = 0;
+  BOOL exists, fragmented = FALSE, ok = FALSE;
+  int fdin;
+
+  truename(src, source);
+  if (!destPath(dest, drive, filename))
+    return FALSE;
+  if (stricmp(src, dest) == 0)
+    return FALSE;  /* let copy() report and skip */
+  if (strpbrk(filename, "\\/:") != NULL)
+    return FALSE;  /* only root directory supported */
+  if (isUnchanged(source, drive, filename, opts))
+    return TRUE;
+
+  ticks = getTicks();
+  fdin = open(source, O_RDONLY | O_BINARY);
+  statFile(STAT_OPEN, ticks, source, (fdin < 0) ? (ULONG)-1 : 0);
+  if (fdin < 0)
+  {
+    printf("%s: can't open %s\n", pgm, source);
+    return FALSE;
+  }
+  /* file may already be in memory, zero padded to whole sectors */
+  if ((cache = cachedSource(source, &filesize, &crc)) == NULL)
+    filesize = filelength(fdin);
+
+  /* obtain exclusive access to drive, DOS buffers flushed so FAT current */
+  beginDriveAccess(drive);
+
+  if (!openVolume(&vol, drive))
+  {
+    if (!vol.ioError)
+      printf("%s: drive %c: is not a usable FAT volume\n", pgm, 'A' + drive);
+    goto done;
+  }
+  clusterSize = (ULONG)vol.secPerClust * SEC_SIZE;
+  count = (filesize + clusterSize - 1) / clusterSize;
+
+  /* need a directory entry, reuse existing one if replacing file */
+  setFilename(entry.dir_name, filename);
+  exists = findRootEntry(&vol, entry.dir_name, &entry, &found, &unused);
+  if (vol.ioError)
+    goto done;
+  if (!exists && !unused.sector)
+  {
+    printf("%s: root directory of drive %c: is full\n", pgm, 'A' + drive);
+    goto done;
+  }
+  if (exists)
+  {
+    oldStart = startCluster(&vol, &entry);
+    oldSize = entry.dir_size;
+  }
+  else
+    found = unused;
+
+  /* locate free clusters, existing file is kept until new one complete */
+  if (count && (start = findFreeRun(&vol, count)) == 0)
+  {
+    if (vol.ioError)
+      goto done;
+    if (!noFallback(drive))
+    {
+      printf("%s: no run of %lu free cluster(s) on drive %c: for %s\n", pgm,
+             (unsigned long)count, 'A' + drive, filename);
+      goto done;
+    }
+    if (countFreeClusters(&vol, &start) < count)
+    {
+      if (!vol.ioError)
+        printf("%s: not enough free space on drive %c: for %s\n", pgm, 'A' + drive, filename);
+      goto done;
+    }
+    fragmented = TRUE;
+  }
+
+  bufSectors = CONTIG_SECTORS;
+  /* whole clusters (or equal parts of them) so no chunk spans two */
+  if (fragmented)
+    for (bufSectors = vol.secPerClust; bufSectors > CONTIG_SECTORS; bufSectors /= 2)
+      ;
+  if ((ULONG)bufSectors * SEC_SIZE > filesize)
+    bufSectors = (unsigned)((filesize + SEC_SIZE - 1) / SEC_SIZE);
+  if (!cache && bufSectors && (buffer = allocBlock((ULONG)bufSectors * SEC_SIZE)) == NULL)
+  {
+    printf("%s: not enough memory to copy %s\n", pgm, source);
+    goto done;
+  }
+
+  if (fragmented)
+    printf("Copying %s, %lu cluster(s) from cluster %lu, no single free run...\n",
+           source, (unsigned long)count, (unsigned long)start);
+  else
+    printf("Copying %s contiguously, %lu cluster(s) at cluster %lu...\n",
+           source, (unsigned long)count, (unsigned long)(count ? start : 0));
+  ticks = getTicks();
+
+  /* write file data into the free clusters a chunk at a time */
+  sector = count ? clusterSector(&vol, start) : 0;
+  for (done = 0; done < filesize; done += (ULONG)n * SEC_SIZE)
+  {
+    ULONG got;
+
+    if (cache != NULL)
+    {
+      got = filesize - done;
+      if (got > (ULONG)bufSectors * SEC_SIZE)
+        got = (ULONG)bufSectors * SEC_SIZE;
+      buffer = hugeAdd(cache, done);
+      n = (unsigned)((got + SEC_SIZE - 1) / SEC_SIZE);
+    }
+    else
+    {
+      ULONG t = getTicks();
+
+      got = hugeRead(fdin, buffer, (ULONG)bufSectors * SEC_SIZE);
+      statFile(STAT_READ, t, source, got);
+      if (got == (ULONG)-1 || got == 0)
+      {
+        printf("Can't read from %s\n", source);
+        break;
+      }
+      crc = updateCRC32(crc, buffer, got);
+      n = (unsigned)((got + SEC_SIZE - 1) / SEC_SIZE);
+      /* zero fill remainder of last sector */
+      for (; got < (ULONG)n * SEC_SIZE; got++)
+        buffer[(unsigned)got] = 0;
+    }
+    if (fragmented && !left)
+    {
+      /* on to next free cluster, the same ones are linked below */
+      if ((cluster = done ? nextFreeCluster(&vol, cluster + 1) : start) == 0)
+        break;
+      sector = clusterSector(&vol, cluster);
+      left = vol.secPerClust;
+    }
+    if (cacheReadWrite(drive, n, sector, buffer, 1) != 0)
+    {
+      printf("%s: failed to write sector %lu on drive %c:\n", pgm,
+             (unsigned long)sector, 'A' + drive);
+      break;
+    }
+    sector += n;
+    if (fragmented)
+      left -= n;
+  }
+  if (!cache && bufSectors)
+    freeBlock(buffer);
+  /* cached sectors are written sorted, so flush after each step to keep
+     the order data, FAT, directory entry, old chain freed; a crash then
+     at worst leaves lost clusters, never an entry pointing at garbage */
+  if (done < filesize || !flushCache(drive))
+    goto done;
+
+  /* link clusters into a chain, then point directory entry at it */
+  if (fragmented)
+  {
+    for (cluster = start, linked = 1; linked < count; linked++)
+    {
+      ULONG next = nextFreeCluster(&vol, cluster + 1);
+
+      setFATEntry(&vol, cluster, next);
+      cluster = next;
+    }
+    setFATEntry(&vol, cluster, vol.eoc);
+  }
+  else
+    for (cluster = start; cluster < start + count; cluster++)
+      setFATEntry(&vol, cluster, (cluster + 1 < start + count) ? cluster + 1 : vol.eoc);
+  if (!flushFAT(&vol) || !flushCache(drive))
+    goto done;
+
+  if (!exists)
+  {
+    memset(&entry, 0, sizeof(entry));
+    setFilename(entry.dir_name, filename);
+    entry.dir_attrib = D_ARCHIVE;
+  }
+  getDirTime(fdin, &entry.dir_date, &entry.dir_time);
+  entry.dir_start = count ? loword(start) : 0;
+  entry.dir_start_high = (vol.fs == FAT32 && count) ? hiword(start) : 0;
+  entry.dir_size = filesize;
+  if (!writeDirEntry(&vol, &found, &entry))
+  {
+    printf("%s: failed to update directory entry for %s\n", pgm, dest);
+    /* release new chain again, so disk is as it was for copy() */
+    if (count)
+    {
+      freeChain(&vol, start);
+      flushFAT(&vol);
+    }
+    goto done;
+  }
+
+  if (!flushCache(drive))
+    goto done;
+
+  /* now release clusters used by prior file */
+  if (exists)
+  {
+    freeChain(&vol, oldStart);
+    flushFAT(&vol);
+  }
+  ok = TRUE;
+
+  ticks = TICKS_TO_MS(getTicks() - ticks);
+  printTransferred(filesize, crc, ticks);
+  opts->written += filesize;
+  spaceUsed(drive, filesize, oldSize);
+
+done:
+  /* release lock, DOS will reread FAT and directory */
+  endDriveAccess(drive);
+  close(fdin);
+  if (!ok && vol.ioError)
+    printf("%s: disk error accessing drive %c:\n", pgm, 'A' + drive);
+  /* file is in place but bad, caller marks drive failed (under DOS
+     copySysFile() writes it again through copy() first) */
+  if (ok && opts->verify && !verifyFile(drive, filename, filesize, crc))
+    ok = FALSE;
+  return ok;
+} /* copyContig */
+
+
+/* disk reads boot sector makes loading chain starting at cluster: one
+   per run of clusters (a seek, and a read for loaders reading runs),
+   plus on FAT32 where only one FAT sector is kept a read each time the
+   chain moves to another FAT sector; also counts clusters and runs */
+static ULONG bootReads(FATVolume *vol, ULONG cluster, ULONG *clusters, ULONG *runs)
+{
+  ULONG prev = 0, fatSector = (ULONG)-1, fatReads = 0;
+  ULONG limit = vol->maxCluster;  /* guard against cyclic chains */
+
+  *clusters = *runs = 0;
+  while (isCluster(vol, cluster) && limit-- && !vol->ioError)
+  {
+    if (cluster != prev + 1)
+      (*runs)++;
+    if (vol->fs == FAT32 && cluster * SIZEOF_CLST32 / SEC_SIZE != fatSector)
+    {
+      fatSector = cluster * SIZEOF_CLST32 / SEC_SIZE;
+      fatReads++;
+    }
+    (*clusters)++;
+    prev = cluster;
+    cluster = getFATEntry(vol, cluster);
+  }
+  return *runs + fatReads;
+}
+
+
+/* if drive:\filename is fragmented moves it to a single run of free
+   clusters, updating its FAT chain and directory entry; the old clusters
+   are only released once the new copy is in place.  Adds reads needed
+   at boot before and after to *before and *after.  Returns FALSE if
+   the file is fragmented but could not be moved; sets *bad if it was
+   moved but the new copy does not verify.
+*/
+static BOOL defragFile(COUNT drive, const BYTE *filename, SYSOptions *opts,
+                       ULONG *before, ULONG *after, BOOL *bad)
+{
+  static BYTE dest[SYS_MAXPATH];
+  static FATVolume vol;
+  struct dirent entry;
+  DirSlot found, unused;
+  ULONG clusters, runs, reads, start, oldStart, cluster, next, run;
+  ULONG sector, dstSector, left, done, size, crc = 0;
+  BYTE FAR *buffer;
+  unsigned n;
+  BOOL ok = TRUE, moved = FALSE;
+
+  if (strpbrk(filename, "\\/:") != NULL)
+    return TRUE;  /* only root directory supported */
+  if (!destPath(dest, drive, filename))
+    return FALSE;
+
+  beginDriveAccess(drive);
+  if (!openVolume(&vol, drive))
+    goto done;
+  setFilename(entry.dir_name, filename);
+  if (!findRootEntry(&vol, entry.dir_name, &entry, &found, &unused))
+    goto done;  /* not there, nothing to do */
+  oldStart = startCluster(&vol, &entry);
+  reads = bootReads(&vol, oldStart, &clusters, &runs);
+  if (vol.ioError)
+    goto done;
+  *before += reads;
+  *after += reads;  /* unless moved */
+  if (runs <= 1)
+  {
+    if (opts->verbose)
+      printf("%s is contiguous, %lu cluster(s)\n", dest, (unsigned long)clusters);
+    goto done;
+  }
+
+  ok = FALSE;
+  if ((start = findFreeRun(&vol, clusters)) == 0)
+  {
+    printf("%s: no run of %lu free clusters to move %s (%lu extents) to\n",
+           pgm, (unsigned long)clusters, dest, (unsigned long)runs);
+    goto done;
+  }
+  if ((buffer = allocBlock((ULONG)CONTIG_SECTORS * SEC_SIZE)) == NULL)
+    goto done;
+  printf("Defragmenting %s, %lu clusters in %lu extents to cluster %lu...\n",
+         dest, (unsigned long)clusters, (unsigned long)runs, (unsigned long)start);
+
+  /* copy data a run of old clusters at a time, checksumming file data */
+  size = entry.dir_size;
+  dstSector = clusterSector(&vol, start);
+  for (cluster = oldStart, done = 0; done < clusters && !vol.ioError; done += run)
+  {
+    for (run = 1, next = getFATEntry(&vol, cluster);
+         next == cluster + run && done + run < clusters; run++)
+      next = getFATEntry(&vol, next);
+    sector = clusterSector(&vol, cluster);
+    for (left = run * vol.secPerClust; left; left -= n)
+    {
+      n = (left > CONTIG_SECTORS) ? CONTIG_SECTORS : (unsigned)left;
+      if (cacheReadWrite(drive, n, sector, buffer, 0) != 0 ||
+          cacheReadWrite(drive, n, dstSector, buffer, 1) != 0)
+      {
+        vol.ioError = TRUE;
+        break;
+      }
+      if (size)
+      {
+        ULONG bytes = ((ULONG)n * SEC_SIZE < size) ? (ULONG)n * SEC_SIZE : size;
+
+        crc = updateCRC32(crc, buffer, bytes);
+        size -= bytes;
+      }
+      sector += n;
+      dstSector += n;
+    }
+    cluster = next;
+  }
+  freeBlock(buffer);
+  if (vol.ioError || !flushCache(drive))
+    goto done;
+
+  /* link new clusters, point directory entry at them, free old ones;
+     each step flushed before the next as in copyContig() */
+  for (cluster = start; cluster < start + clusters; cluster++)
+    setFATEntry(&vol, cluster, (cluster + 1 < start + clusters) ? cluster + 1 : vol.eoc);
+  if (!flushFAT(&vol) || !flushCache(drive))
+    goto done;
+  entry.dir_start = loword(start);
+  entry.dir_start_high = (vol.fs == FAT32) ? hiword(start) : 0;
+  if (!writeDirEntry(&vol, &found, &entry))
+  {
+    printf("%s: failed to update directory entry for %s\n", pgm, dest);
+    freeChain(&vol, start);  /* file stays where it was */
+    flushFAT(&vol);
+    goto done;
+  }
+  if (!flushCache(drive))
+    goto done;
+  freeChain(&vol, oldStart);
+  if (!flushFAT(&vol))
+    goto done;
+
+  *after += bootReads(&vol, start, &clusters, &runs) - reads;
+  ok = moved = TRUE;
+
+done:
+  endDriveAccess(drive);
+  if (vol.ioError)
+  {
+    printf("%s: disk error accessing drive %c:\n", pgm, 'A' + drive);
+    ok = FALSE;
+  }
+  if (moved && opts->verify && !verifyFile(drive, filename, entry.dir_size, crc))
+    *bad = TRUE;
+  return ok;
+} /* defragFile */
+
+
+/* moves fragmented kernel and shell files on destination drive into
+   single runs of clusters, then reports reads saved at boot; sets
+   *moved if any file was moved, returns FALSE if a moved file does
+   not verify (files merely left fragmented are not an error) */
+BOOL defragSystem(SYSOptions *opts, BOOL *moved)
+{
+  ULONG before = 0, after = 0;
+  int failed = 0;
+  BOOL bad = FALSE;
+
+  printf("Checking system files for fragmentation...\n");
+  if (!defragFile(opts->dstDrive, opts->kernel.kernel, opts, &before, &after, &bad))
+    failed++;
+  if (opts->kernel.dos &&
+      !defragFile(opts->dstDrive, opts->kernel.dos, opts, &before, &after, &bad))
+    failed++;
+  if (!defragFile(opts->dstDrive, "COMMAND.COM", opts, &before, &after, &bad))
+    failed++;
+
+  if (before > after)
+    printf("Defragmenting saved %lu of %lu disk reads at boot\n",
+           (unsigned long)(before - after), (unsigned long)before);
+  else if (!failed)
+    printf("System files are not fragmented\n");
+  if (failed)
+    printf("%s: %d file(s) left fragmented\n", pgm, failed);
+  *moved = before > after;
+  return !bad;
+}
+
+#endif /* WITHCONTIG */
@@ -29,16 +29,17 @@
 #include "sys.h"
 #include "xstructs.h"
 #include "diskio.h"
+#include "fatio.h"
 
 #ifdef __TURBOC__
 #include <dir.h>
 #include <mem.h>
+#elif defined __unix__
+#include <sys/statvfs.h>
 #else
 #include <memory.h>
 #endif
 
-#define COPY_SIZE       0x4000
-
 
 #ifdef _WIN32
 
@@ -49,26 +50,25 @@ void truename(char *dest, const char *src)
 }
 
 /*
- * Returns TRUE if `drive` has at least `bytes` free space, FALSE otherwise.
+ * Obtains free space of `drive` in bytes (at most 4GB-1) and its cluster size,
+ * returns FALSE if unable to.
  */
-BOOL check_space(COUNT drive, ULONG bytes)
+static BOOL queryFreeSpace(COUNT drive, ULONG *bytes, ULONG *clusterSize)
 {
   ULARGE_INTEGER freeBytes;
+  DWORD secPerClust, bytesPerSec, freeClusters, totalClusters;
   char *drivename = "A:\\";
   drivename[0] = 'A' + drive;
-  if (GetDiskFreeSpaceExA(drivename, &freeBytes, NULL, NULL))
-  {
-    if (freeBytes.QuadPart >= bytes) 
-      return TRUE;
-  }
-  return FALSE;
-} /* check_space */
-
-
-#define allocBlock(blksize) (BYTE *)malloc((unsigned)(blksize))
-#define freeBlock(ptr) free((void *)(ptr))
+  if (!GetDiskFreeSpaceExA(drivename, &freeBytes, NULL, NULL))
+    return FALSE;
+  *bytes = freeBytes.HighPart ? 0xFFFFFFFFUL : freeBytes.LowPart;
+  if (GetDiskFreeSpaceA(drivename, &secPerClust, &bytesPerSec, &freeClusters, &totalClusters))
+    *clusterSize = secPerClust * bytesPerSec;
+  else
+    *clusterSize = SEC_SIZE;
+  return TRUE;
+} /* queryFreeSpace */
 
-#define normalizePtr(ptr)
 
 
 typedef struct _utimbuf filetime_t;
@@ -90,28 +90,63 @@ void getFileTime(int fdin, filetime_t *filetime)
 #define setFileTimeAndClose(fname, fd, filetime) close(fdout); _utime(fname, (struct _utimbuf *)filetime)
 #endif
 
+#elif defined __unix__
+
+/* dest is SYS_MAXPATH (PATH_MAX) bytes, as realpath() requires */
+void truename(char *dest, const char *src)
+{
+  if (realpath(src, dest) == NULL)
+    snprintf(dest, SYS_MAXPATH, "%s", src);
+}
+
+/*
+ * Obtains free space of `drive` in bytes (at most 4GB-1) and its cluster size,
+ * returns FALSE if unable to.
+ */
+static BOOL queryFreeSpace(COUNT drive, ULONG *bytes, ULONG *clusterSize)
+{
+  struct statvfs fs;
+  unsigned long long avail;
+
+  /* count free clusters of image's FAT */
+  if (isImageDrive(drive))
+  {
+    static FATVolume vol;
+
+    if (!openVolume(&vol, drive))
+      return FALSE;
+    *clusterSize = (ULONG)vol.secPerClust * SEC_SIZE;
+    avail = (unsigned long long)countFreeClusters(&vol, NULL) * *clusterSize;
+    *bytes = (avail > 0xFFFFFFFFUL) ? 0xFFFFFFFFUL : (ULONG)avail;
+    return !vol.ioError;
+  }
+
+  if (statvfs(drivePath(drive), &fs) != 0)
+    return FALSE;
+  avail = (unsigned long long)fs.f_bavail * fs.f_frsize;
+  *bytes = (avail > 0xFFFFFFFFUL) ? 0xFFFFFFFFUL : (ULONG)avail;
+  *clusterSize = fs.f_bsize;
+  return TRUE;
+} /* queryFreeSpace */
+
+typedef struct utimbuf filetime_t;
+
+/* get original file date and time */
+static void getFileTime(int fdin, filetime_t *filetime)
+{
+  struct stat fstatbuf;
+  if (fstat(fdin, &fstatbuf))
+    memset(&fstatbuf, 0, sizeof(fstatbuf));
+  filetime->actime = filetime->modtime = fstatbuf.st_mtime;
+}
+
+/* set copied files time to match original */
+#define setFileTimeAndClose(fname, fd, filetime) close(fd); utime(fname, filetime)
+
 #else
 
 #ifdef __WATCOMC__
 
-long filelength(int __handle);
-#pragma aux filelength = \
-      "mov ax, 0x4202" \
-      "xor cx, cx" \
-      "xor dx, dx" \
-      "int 0x21" \
-      "push ax" \
-      "push dx" \
-      "mov ax, 0x4200" \
-      "xor cx, cx" \
-      "xor dx, dx" \
-      "int 0x21" \
-      "pop dx" \
-      "pop ax" \
-      parm [bx] \
-      modify [cx] \
-      value [dx ax];
-
 unsigned getextdrivespace(void far *drivename, void *buf, unsigned buf_size);
 #pragma aux getextdrivespace =  \
       "mov ax, 0x7303"    \
@@ -159,9 +194,10 @@ unsigned getextdrivespace(void far *drivename, void *buf, unsigned buf_size)
 /* static */ struct xfreespace x; /* we make this static to be 0 by default -
                                      this avoids FAT misdetections */
 /*
- * Returns TRUE if `drive` has at least `bytes` free space, FALSE otherwise.
+ * Obtains free space of `drive` in bytes (at most 4GB-1) and its cluster size,
+ * returns FALSE if unable to.
  */
-BOOL check_space(COUNT drive, ULONG bytes)
+static BOOL queryFreeSpace(COUNT drive, ULONG *bytes, ULONG *clusterSize)
 {
   /* try extended drive space check 1st, if unsupported or other error fallback to standard check */
   char *drivename = "A:\\";
@@ -171,49 +207,28 @@ BOOL check_space(COUNT drive, ULONG bytes)
 #ifdef __TURBOC__
     struct dfree df;
     getdfree(drive + 1, &df);
-    return (ULONG)df.df_avail * df.df_sclus * df.df_bsec >= bytes;
+    if (df.df_sclus == 0xFFFF)
+      return FALSE;
+    *clusterSize = (ULONG)df.df_sclus * df.df_bsec;
+    *bytes = (ULONG)df.df_avail * *clusterSize;
 #else
     struct _diskfree_t df;
-    _dos_getdiskfree(drive + 1, &df);
-    return (ULONG)df.avail_clusters * df.sectors_per_cluster
-      * df.bytes_per_sector >= bytes;
+    if (_dos_getdiskfree(drive + 1, &df) != 0)
+      return FALSE;
+    *clusterSize = (ULONG)df.sectors_per_cluster * df.bytes_per_sector;
+    *bytes = (ULONG)df.avail_clusters * *clusterSize;
 #endif
   }
   else
-    return x.xfs_freeclusters > (bytes / (x.xfs_clussize * x.xfs_secsize));
-} /* check_space */
-
-
-/* allocate memory from DOS, return NULL on error, pointer to buffer otherwise */
-BYTE FAR* allocBlock(ULONG memsize)
-{
-  unsigned dseg;
-#ifdef __TURBOC__
-  if (allocmem((unsigned)((memsize+15)>>4), &dseg)!=-1)
-#else
-  if (_dos_allocmem((unsigned)((memsize+15)>>4), &dseg)!=0)
-#endif
-    return NULL; /* failed to allocate memory */
-    
-  return MK_FP(dseg, 0); /* success */
-}
-
-#ifdef __TURBOC__
-#define freeBlock(ptr) freemem(FP_SEG(ptr))
-#else
-#define freeBlock(ptr) _dos_freemem(FP_SEG(ptr))
-#endif
-
-/* adjust segment:offset to maintain valid, takes a pointer to a far pointer to updated */
-void normalizePtr(BYTE FAR **ptr)
-{
-  register BYTE FAR *bufptr = *ptr;
-  if (FP_OFF(bufptr) > 0x7777) /* watcom needs this in tiny model */
   {
-    bufptr = MK_FP(FP_SEG(bufptr)+0x700, FP_OFF(bufptr)-0x7000);
+    *clusterSize = x.xfs_clussize * x.xfs_secsize;
+    if (!*clusterSize)
+      return FALSE;
+    *bytes = (x.xfs_freeclusters > 0xFFFFFFFFUL / *clusterSize) ? 0xFFFFFFFFUL
+             : x.xfs_freeclusters * *clusterSize;
   }
-  *ptr = bufptr;
-}
+  return TRUE;
+} /* queryFreeSpace */
 
 
 #if defined __WATCOMC__ || defined _MSC_VER /* || defined __BORLANDC__ */
@@ -246,25 +261,539 @@ void normalizePtr(BYTE FAR **ptr)
 #endif /* _WIN32 */
 
 
+/* forms full name of filename on drive in dest (SYS_MAXPATH bytes),
+   returns FALSE if it would not fit */
+BOOL destPath(BYTE *dest, COUNT drive, const BYTE *filename)
+{
+#ifdef __unix__
+  BYTE *p;
+
+  if ((unsigned)snprintf(dest, SYS_MAXPATH, "%s/%s", drivePath(drive), filename)
+      >= SYS_MAXPATH)
+  {
+    printf("%s: path too long for %s\n", pgm, filename);
+    return FALSE;
+  }
+  for (p = dest; *p; p++)
+    if (*p == '\\')
+      *p = '/';
+#else
+  if (strlen(filename) + 4 > SYS_MAXPATH)  /* X:\ and terminating 0 */
+  {
+    printf("%s: path too long for %s\n", pgm, filename);
+    return FALSE;
+  }
+  sprintf(dest, "%c:\\%s", 'A' + drive, filename);
+#endif
+  return TRUE;
+}
+
+
+/* free space of each drive, obtained once then adjusted as files are
+   written so later checks need not ask DOS again (on FAT32 the first
+   query may make DOS scan the whole FAT to count free clusters) */
+static ULONG freeSpace[26];     /* bytes, at most 4GB-1 */
+static ULONG freeClusterSize[26];
+static BOOL freeKnown[26];
+
+/* obtains free space from FAT32 FSInfo sector, only a hint so just used
+   when DOS can't be asked; FALSE if not FAT32 or free count not known */
+static BOOL fsInfoFreeSpace(COUNT drive, ULONG *bytes, ULONG *clusterSize)
+{
+  static FATVolume vol;
+  UBYTE sector[SEC_SIZE];
+  struct fsinfo *fi;
+  ULONG freeClusters;
+
+  if (!openVolume(&vol, drive) || vol.fs != FAT32)
+    return FALSE;
+  if ((fi = readFSInfo(&vol, sector)) == NULL)
+    return FALSE;
+  freeClusters = (ULONG)fi->fi_nfreeclst;
+  if (freeClusters == FSINFO_UNKNOWN || freeClusters > vol.maxCluster - 1)
+    return FALSE;
+
+  *clusterSize = (ULONG)vol.secPerClust * SEC_SIZE;
+  *bytes = (freeClusters > 0xFFFFFFFFUL / *clusterSize) ? 0xFFFFFFFFUL
+           : freeClusters * *clusterSize;
+  return TRUE;
+}
+
+/*
+ * Returns TRUE if `drive` has at least `bytes` free space, FALSE otherwise.
+ */
+BOOL check_space(COUNT drive, ULONG bytes)
+{
+  if (!freeKnown[drive])
+  {
+    if (!queryFreeSpace(drive, &freeSpace[drive], &freeClusterSize[drive]) &&
+        !fsInfoFreeSpace(drive, &freeSpace[drive], &freeClusterSize[drive]))
+      return FALSE;
+    freeKnown[drive] = TRUE;
+  }
+  return freeSpace[drive] >= bytes;
+} /* check_space */
+
+/* adjusts cached free space of drive after bytes written to a file that
+   replaced one of replaced bytes (0 if new), only the change is charged */
+void spaceUsed(COUNT drive, ULONG bytes, ULONG replaced)
+{
+  ULONG clusterSize = freeClusterSize[drive];
+
+  if (!freeKnown[drive])
+    return;
+  if (clusterSize)
+  {
+    bytes = ((bytes + clusterSize - 1) / clusterSize) * clusterSize;
+    replaced = ((replaced + clusterSize - 1) / clusterSize) * clusterSize;
+  }
+  if (bytes >= replaced)
+  {
+    bytes -= replaced;
+    freeSpace[drive] = (freeSpace[drive] > bytes) ? freeSpace[drive] - bytes : 0;
+  }
+  else  /* file shrank */
+  {
+    replaced -= bytes;
+    freeSpace[drive] = (freeSpace[drive] > 0xFFFFFFFFUL - replaced) ? 0xFFFFFFFFUL
+                       : freeSpace[drive] + replaced;
+  }
+}
+
+/* after files are written to a FAT32 drive, sets its FSInfo free cluster
+   count and next free cluster to their true values, so DOS need not
+   count free clusters itself (scanning the whole FAT) when it boots */
+BOOL updateFSInfo(COUNT drive, BOOL verbose)
+{
+  static FATVolume vol;
+  UBYTE sector[SEC_SIZE];
+  struct fsinfo *fi;
+  ULONG freeCount, nextFree;
+  BOOL ok = FALSE;
+
+  /* DOS buffers are flushed by locking, so FAT on disk is current */
+  beginDriveAccess(drive);
+  if (!openVolume(&vol, drive) || vol.fs != FAT32 ||
+      (fi = readFSInfo(&vol, sector)) == NULL)
+    goto done;
+  freeCount = countFreeClusters(&vol, &nextFree);
+  if (vol.ioError)
+    goto done;
+  if (!nextFree)
+    nextFree = FSINFO_UNKNOWN;
+  if ((ULONG)fi->fi_nfreeclst == freeCount && (ULONG)fi->fi_cluster == nextFree)
+    ok = TRUE;
+  else
+  {
+    if (verbose)
+      printf("Updating FSInfo: %lu free cluster(s), next free %lu (was %lu, %lu)\n",
+             (unsigned long)freeCount, (unsigned long)nextFree,
+             (unsigned long)fi->fi_nfreeclst, (unsigned long)fi->fi_cluster);
+    ok = writeFSInfo(&vol, freeCount, nextFree);
+  }
+
+done:
+  endDriveAccess(drive);
+  if (!ok && vol.ioError)
+    printf("%s: failed to update FSInfo sector of drive %c:\n", pgm, 'A' + drive);
+  return ok;
+}
 
 
 BYTE copybuffer[COPY_SIZE];
+ULONG copyChunkSize = 0;
+int copyBufferCount = COPY_BUFFERS;
+
+
+/* returns bytes per second given bytes transferred in elapsed milliseconds */
+ULONG bytesPerSec(ULONG bytes, ULONG ms)
+{
+  if (!ms) return 0;
+  /* split to avoid overflowing 32 bits for larger transfers */
+  return (bytes / ms) * 1000 + (bytes % ms) * 1000 / ms;
+}
+
+/* prints size, checksum, and rate of a completed file transfer */
+void printTransferred(ULONG bytes, ULONG crc, ULONG ms)
+{
+  printf("%lu Bytes transferred, CRC32 %08lX", (unsigned long)bytes, (unsigned long)crc);
+  if (ms)
+    printf(", %lu bytes/sec", (unsigned long)bytesPerSec(bytes, ms));
+  printf("\n");
+}
+
+
+typedef struct {
+  BYTE FAR *data;               /* start of (huge) buffer */
+  ULONG size;                   /* capacity in bytes */
+  ULONG used;                   /* bytes currently held */
+} CopyBuffer;
+
+/* allocate up to most (and copyBufferCount) buffers sized to smaller of
+   the file, copyChunkSize, and available memory; if no memory can be
+   allocated the static copybuffer is used as the only buffer.  Returns
+   number of buffers available.
+*/
+static int allocCopyBuffers(CopyBuffer *buf, ULONG filesize, int most)
+{
+  int count = (copyBufferCount > 0 && copyBufferCount < most) ?
+              copyBufferCount : most;
+  ULONG remaining = filesize;
+  ULONG per = availBlock() / count;
+  ULONG least = COPY_SIZE;      /* not worth allocating smaller buffers */
+  int n;
+
+  if (copyChunkSize && per > copyChunkSize)
+    per = copyChunkSize;
+  if (copyChunkSize && least > copyChunkSize)
+    least = copyChunkSize;
+  per &= ~(ULONG)(SEC_SIZE - 1);  /* keep transfers whole sectors */
+
+  for (n = 0; (n < count) && remaining && (per >= least); n++)
+  {
+    buf[n].size = (remaining < per) ? remaining : per;
+    if ((buf[n].data = allocBlock(buf[n].size)) == NULL)
+      break;
+    remaining -= buf[n].size;
+  }
+
+  if (!n)  /* low memory (or empty file), fall back to simple copy loop */
+  {
+    buf[0].data = copybuffer;
+    buf[0].size = COPY_SIZE;
+    n = 1;
+  }
+  return n;
+}
+
+static void freeCopyBuffers(CopyBuffer *buf, int n)
+{
+  while (n-- > 0)
+    if (buf[n].data != (BYTE FAR *)copybuffer)
+      freeBlock(buf[n].data);
+}
+
+
+/* reports whether drive:\filename occupies a single run of clusters,
+   only done for files in root directory of FAT volumes */
+static void reportExtents(COUNT drive, const BYTE *filename, const BYTE *dest)
+{
+  static FATVolume vol;
+  struct dirent entry;
+  DirSlot found, unused;
+  BYTE name[FNAME_SIZE + FEXT_SIZE];
+  ULONG clusters, extents;
+
+  if (strpbrk(filename, "\\/:") != NULL)
+    return;
+
+  /* ensure DOS has written out FAT and directory */
+  reset_drive(drive);
+  if (!openVolume(&vol, drive))
+    return;
+  setFilename(name, filename);
+  if (!findRootEntry(&vol, name, &entry, &found, &unused))
+    return;
+  countExtents(&vol, startCluster(&vol, &entry), &clusters, &extents);
+  if (vol.ioError || !clusters)
+    return;
+
+  if (extents == 1)
+    printf("%s is contiguous, %lu cluster(s)\n", dest, (unsigned long)clusters);
+  else
+    printf("%s is fragmented, %lu clusters in %lu extents\n", dest,
+           (unsigned long)clusters, (unsigned long)extents);
+}
+
+
+/* source files held in memory when installing to several drives,
+   so each is read only once; data is padded with zeros to a whole
+   number of sectors so it may be written directly by sector
+*/
+#define MAX_CACHED 4
+typedef struct {
+  const BYTE *source;           /* name as passed to copy() */
+  BYTE FAR *data;
+  ULONG size;                   /* bytes of file data */
+  ULONG crc;
+} CachedSource;
+static CachedSource cached[MAX_CACHED];
+static int cachedCount = 0;
+
+/* reads source into memory, FALSE if it can't (copy() reads as usual) */
+BOOL cacheSource(const BYTE *source)
+{
+  CachedSource *c = &cached[cachedCount];
+  ULONG padded, i;
+  int fd;
+
+  if (cachedCount >= MAX_CACHED || cachedSource(source, NULL, NULL) != NULL)
+    return FALSE;
+  if ((fd = open(source, O_RDONLY | O_BINARY)) < 0)
+    return FALSE;
+
+  c->size = filelength(fd);
+  padded = (c->size + SEC_SIZE - 1) & ~(ULONG)(SEC_SIZE - 1);
+  if (!padded || (c->data = allocBlock(padded)) == NULL)
+  {
+    close(fd);
+    return FALSE;
+  }
+  if (hugeRead(fd, c->data, c->size) != c->size)
+  {
+    freeBlock(c->data);
+    close(fd);
+    return FALSE;
+  }
+  close(fd);
+
+  for (i = c->size; i < padded; i++)
+    *hugeAdd(c->data, i) = 0;
+  c->crc = updateCRC32(0, c->data, c->size);
+  c->source = source;
+  cachedCount++;
+  return TRUE;
+}
+
+/* returns data of source if held in memory (optionally its size and
+   CRC-32), NULL if not */
+BYTE FAR *cachedSource(const BYTE *source, ULONG *size, ULONG *crc)
+{
+  int i;
+
+  for (i = 0; i < cachedCount; i++)
+  {
+    if (stricmp(cached[i].source, source) == 0)
+    {
+      if (size) *size = cached[i].size;
+      if (crc) *crc = cached[i].crc;
+      return cached[i].data;
+    }
+  }
+  return NULL;
+}
+
+void freeSources(void)
+{
+  while (cachedCount)
+    freeBlock(cached[--cachedCount].data);
+}
+
+
+/* reads open file fd from current position to end computing its CRC-32,
+   returns bytes read or (ULONG)-1 on error */
+static ULONG checksumFile(int fd, ULONG size, ULONG *crc)
+{
+  CopyBuffer buf;
+  ULONG got, total = 0;
+  int nbuf;
+
+  /* one large buffer is sufficient, we only read */
+  nbuf = allocCopyBuffers(&buf, size, 1);
+  *crc = 0;
+  do
+  {
+    if ((got = hugeRead(fd, buf.data, buf.size)) == (ULONG)-1)
+    {
+      total = (ULONG)-1;
+      break;
+    }
+    *crc = updateCRC32(*crc, buf.data, got);
+    total += got;
+  } while (got == buf.size);
+  freeCopyBuffers(&buf, nbuf);
+  return total;
+}
+
+
+#ifdef __unix__
+/* computes CRC-32 of file in root directory of an image by following its
+   cluster chain, returns its size or (ULONG)-1 if it can not be read */
+static ULONG checksumImageFile(COUNT drive, const BYTE *filename, ULONG *crc)
+{
+  static FATVolume vol;
+  struct dirent entry;
+  DirSlot found, unused;
+  BYTE name[FNAME_SIZE + FEXT_SIZE];
+  BYTE FAR *buffer;
+  ULONG cluster, left, clusterSize, n;
+
+  *crc = 0;
+  if (strpbrk(filename, "\\/:") != NULL || !openVolume(&vol, drive))
+    return (ULONG)-1;
+  setFilename(name, filename);
+  if (!findRootEntry(&vol, name, &entry, &found, &unused))
+    return (ULONG)-1;
+  clusterSize = (ULONG)vol.secPerClust * SEC_SIZE;
+  if ((buffer = allocBlock(clusterSize)) == NULL)
+    return (ULONG)-1;
+
+  left = entry.dir_size;
+  for (cluster = startCluster(&vol, &entry); left && isCluster(&vol, cluster);
+       cluster = getFATEntry(&vol, cluster))
+  {
+    ULONG start = getTicks();
+    int rc;
+
+    n = (left < clusterSize) ? left : clusterSize;
+    rc = MyAbsReadWrite(drive, vol.secPerClust, clusterSector(&vol, cluster), buffer, 0);
+    statDisk(STAT_SECREAD, start, drive, clusterSector(&vol, cluster), vol.secPerClust);
+    if (rc != 0)
+      break;
+    *crc = updateCRC32(*crc, buffer, n);
+    left -= n;
+  }
+  freeBlock(buffer);
+  return (left || vol.ioError) ? (ULONG)-1 : entry.dir_size;
+}
+#endif
+
+
+/* reads drive:\filename back from disk and compares its size and CRC-32
+   to what was written, returns TRUE if they match */
+BOOL verifyFile(COUNT drive, const BYTE *filename, ULONG size, ULONG crc)
+{
+  static BYTE dest[SYS_MAXPATH];
+  ULONG total, check;
+  int fd;
+
+  if (!destPath(dest, drive, filename))
+    return FALSE;
+
+  /* have DOS write out and drop its buffers so we read what is on disk */
+  reset_drive(drive);
+
+#ifdef __unix__
+  if (isImageDrive(drive))
+    total = checksumImageFile(drive, filename, &check);
+  else
+#endif
+  {
+    if ((fd = open(dest, O_RDONLY | O_BINARY)) < 0)
+    {
+      printf("%s: failed to open \"%s\" to verify\n", pgm, dest);
+      return FALSE;
+    }
+    total = checksumFile(fd, size, &check);
+    close(fd);
+  }
+
+  if (total == (ULONG)-1)
+  {
+    printf("Can't read from %s\n", dest);
+    return FALSE;
+  }
+  if (total != size || check != crc)
+  {
+    printf("%s: verify failed for %s, read back %lu bytes, CRC32 %08lX\n",
+           pgm, dest, (unsigned long)total, (unsigned long)check);
+    return FALSE;
+  }
+  printf("Verified %s\n", dest);
+  return TRUE;
+} /* verifyFile */
+
+
+/* for incremental updates, returns TRUE if drive:\filename already
+   matches source by size and time stamp, or by size and CRC-32 */
+BOOL isUnchanged(const BYTE *source, COUNT drive, const BYTE *filename, SYSOptions *opts)
+{
+  static BYTE dest[SYS_MAXPATH];
+  filetime_t srcTime, destTime;
+  ULONG size, srcCRC, destCRC;
+  int fdin, fdout;
+  BOOL same = FALSE;
+
+  if (opts->incremental == COPYALL)
+    return FALSE;
+
+  if (!destPath(dest, drive, filename))
+    return FALSE;
+  if ((fdin = open(source, O_RDONLY | O_BINARY)) < 0)
+    return FALSE;  /* let copy() report the error */
+#ifdef __unix__
+  /* no host file in an image to get time stamp of, always compare CRCs */
+  if (isImageDrive(drive))
+  {
+    size = filelength(fdin);
+    if (cachedSource(source, NULL, &srcCRC) != NULL || checksumFile(fdin, size, &srcCRC) == size)
+      same = checksumImageFile(drive, filename, &destCRC) == size && srcCRC == destCRC;
+    close(fdin);
+    if (same)
+      printf("%s unchanged\n", dest);
+    return same;
+  }
+#endif
+  if ((fdout = open(dest, O_RDONLY | O_BINARY)) < 0)
+  {
+    close(fdin);
+    return FALSE;  /* nothing there yet */
+  }
+
+  size = filelength(fdin);
+  if ((ULONG)filelength(fdout) == size)
+  {
+    if (opts->incremental == SAMECRC)
+    {
+      /* compare contents, ignoring time stamps */
+      if (cachedSource(source, NULL, &srcCRC) == NULL &&
+          checksumFile(fdin, size, &srcCRC) != size)
+        same = FALSE;  /* can't read source, let copy() report it */
+      else
+        same = checksumFile(fdout, size, &destCRC) == size && srcCRC == destCRC;
+    }
+    else
+    {
+      memset(&srcTime, 0, sizeof(srcTime));
+      memset(&destTime, 0, sizeof(destTime));
+      getFileTime(fdin, &srcTime);
+      getFileTime(fdout, &destTime);
+      same = memcmp(&srcTime, &destTime, sizeof(filetime_t)) == 0;
+    }
+  }
+  close(fdout);
+  close(fdin);
+
+  if (same)
+    printf("%s unchanged\n", dest);
+  return same;
+} /* isUnchanged */
 
 
 /* copies file (path+filename specified by srcFile) to drive:\filename */
-BOOL copy(const BYTE *source, COUNT drive, const BYTE * filename)
+BOOL copy(const BYTE *source, COUNT drive, const BYTE * filename, SYSOptions *opts)
 {
   static BYTE src[SYS_MAXPATH];
   static BYTE dest[SYS_MAXPATH];
-  unsigned ret;
   int fdin, fdout;
-  ULONG copied = 0;
+  ULONG copied = 0, crc = 0;
+  ULONG start, elapsed, size, replaced;
+  struct stat deststat;
   filetime_t filetime;
+  CopyBuffer buf[COPY_BUFFERS];
+  int nbuf = 0, filled, i;
+  BOOL eof = FALSE;
+  BYTE FAR *data;
+
+#if defined __unix__ && defined WITHCONTIG
+  /* an image has no host file system to copy through, write it directly */
+  if (isImageDrive(drive))
+  {
+    /* copyContig() only writes to the root directory */
+    if (strpbrk(filename, "\\/:") != NULL)
+    {
+      printf("%s: %s: subdirectories not supported on images\n", pgm, filename);
+      return FALSE;
+    }
+    return copyContig(source, drive, filename, opts);
+  }
+#endif
 
   printf("Copying %s...\n", source);
 
   truename(src, source);
-  sprintf(dest, "%c:\\%s", 'A' + drive, filename);
+  if (!destPath(dest, drive, filename))
+    return FALSE;
   if (stricmp(src, dest) == 0)
   {
     printf("%s: source and destination are identical: skipping \"%s\"\n",
@@ -272,7 +801,13 @@ BOOL copy(const BYTE *source, COUNT drive, const BYTE * filename)
     return TRUE;
   }
 
-  if ((fdin = open(source, O_RDONLY | O_BINARY)) < 0)
+  if (isUnchanged(source, drive, filename, opts))
+    return TRUE;
+
+  start = getTicks();
+  fdin = open(source, O_RDONLY | O_BINARY);
+  statFile(STAT_OPEN, start, source, (fdin < 0) ? (ULONG)-1 : 0);
+  if (fdin < 0)
   {
     printf("%s: failed to open \"%s\"\n", pgm, source);
     return FALSE;
@@ -281,96 +816,104 @@ BOOL copy(const BYTE *source, COUNT drive, const BYTE * filename)
   /* get original creation file date & time */
   getFileTime(fdin, &filetime);
 
-  if (!check_space(drive, filelength(fdin)))
+  /* data itself may already be in memory */
+  if ((data = cachedSource(source, &size, &crc)) == NULL)
+    size = filelength(fdin);
+
+  /* a file being replaced gives its space back when truncated */
+  replaced = (timedStat(dest, &deststat) == 0) ? (ULONG)deststat.st_size : 0;
+  if (!opts->spaceChecked && !check_space(drive, (size > replaced) ? size - replaced : 0))
   {
     printf("%s: Not enough space to transfer %s\n", pgm, filename);
     close(fdin);
     return FALSE;
   }
 
-  if ((fdout =
-       open(dest, O_RDWR | O_TRUNC | O_CREAT | O_BINARY,
-            S_IREAD | S_IWRITE)) < 0)
+  /* DOS is about to change FAT and directory, drop our copies of them */
+  invalidateCache(drive);
+
+  start = getTicks();
+  fdout = open(dest, O_RDWR | O_TRUNC | O_CREAT | O_BINARY, S_IREAD | S_IWRITE);
+  statFile(STAT_OPEN, start, dest, (fdout < 0) ? (ULONG)-1 : 0);
+  if (fdout < 0)
   {
     printf(" %s: can't create\"%s\"\nDOS errnum %d\n", pgm, dest, errno);
     close(fdin);
     return FALSE;
   }
 
-#if 0 /* simple copy loop, read chunk then write chunk, repeat until all data copied */
-  while ((ret = read(fdin, copybuffer, COPY_SIZE)) > 0)
+  /* reserve all space up front so DOS allocates the clusters in one
+     go rather than as file grows; if not possible file just grows */
+  setFileSize(fdout, size);
+
+  /* stream file through ping-pong buffers sized to available memory;
+     DOS offers no asynchronous I/O so the buffers are filled back to back
+     then drained back to back, which on single drive systems also keeps
+     the number of disk swaps down.  A file that fits in the buffers is
+     read in whole, then written out whole as before.
+  */
+  start = getTicks();
+  if (data != NULL)
   {
-    if (write(fdout, copybuffer, ret) != ret)
+    if (size)
     {
-      printf("Can't write %u bytes to %s\n", ret, dest);
-      close(fdout);
-      unlink(dest);
-      return FALSE;
-    }
-    copied += ret;
-  }
- #else /* read in whole file, then write out whole file */
-  {
-    ULONG filesize;
-    BYTE far *buffer, far *bufptr;
-    UWORD offs;
-    unsigned chunk_size;
-    
-    /* get length of file to copy, then allocate enough memory for whole file */
-    filesize = filelength(fdin);
-      buffer = allocBlock(filesize);
-      if (buffer == NULL)
-      {
-        printf("Not enough memory to buffer %lu bytes for %s\n", filesize, source);
-        return FALSE;
-      }
-    bufptr = buffer;
+      ULONG t = getTicks();
 
-    /* read in whole file, a chunk at a time; adjust size of last chunk to match remaining bytes */
-    chunk_size = (COPY_SIZE < filesize)?COPY_SIZE:(unsigned)filesize;
-    while ((ret = read(fdin, copybuffer, chunk_size)) > 0)
+      copied = hugeWrite(fdout, data, size);
+      statFile(STAT_WRITE, t, dest, copied);
+    }
+    if (copied != size)
     {
-      for (offs = 0; offs < ret; offs++)
-      {
-        *bufptr = copybuffer[offs];
-        bufptr++;
-        normalizePtr(&bufptr);
-      }
-      /* keep track of how much read in, and only read in filesize bytes */
-      copied += ret;
-      chunk_size = (COPY_SIZE < (filesize-copied))?COPY_SIZE:(unsigned)(filesize-copied);
+      printf("Can't write %lu bytes to %s\n", (unsigned long)size, dest);
+      goto copyfailed;
     }
-
-    /* write out file, a chunk at a time; adjust size of last chunk to match remaining bytes */
-    bufptr = buffer;
-    copied = 0;
+  }
+  else
+  {
+    nbuf = allocCopyBuffers(buf, size, COPY_BUFFERS);
     do
     {
-      /* keep track of how much read in, and only read in filesize bytes */
-      chunk_size = (COPY_SIZE < (filesize-copied))?COPY_SIZE:(unsigned)(filesize-copied);
-      copied += chunk_size;
-
-      /* setup chunk of data to be written out */
-      for (offs = 0; offs < chunk_size; offs++)
+      /* fill each buffer from source until all full or end of file reached */
+      for (filled = 0; (filled < nbuf) && !eof; filled++)
       {
-        copybuffer[offs] = *bufptr;
-        bufptr++;
-        normalizePtr(&bufptr);
+        ULONG t = getTicks();
+
+        buf[filled].used = hugeRead(fdin, buf[filled].data, buf[filled].size);
+        statFile(STAT_READ, t, source, buf[filled].used);
+        if (buf[filled].used == (ULONG)-1)
+        {
+          printf("Can't read from %s\n", source);
+          goto copyfailed;
+        }
+        eof = buf[filled].used < buf[filled].size;
+        /* checksum while data is in memory, costs no extra I/O */
+        crc = updateCRC32(crc, buf[filled].data, buf[filled].used);
       }
 
-      /* write the data to disk, abort on any error */
-      if ((unsigned)write(fdout, copybuffer, chunk_size) != chunk_size)
+      /* then drain each filled buffer to destination, abort on any error */
+      for (i = 0; i < filled; i++)
       {
-        printf("Can't write %u bytes to %s\n", ret, dest);
-        close(fdout);
-        unlink(dest);
-        return FALSE;
+        ULONG t = getTicks(), wrote = 0;
+
+        if (buf[i].used)
+        {
+          wrote = hugeWrite(fdout, buf[i].data, buf[i].used);
+          statFile(STAT_WRITE, t, dest, wrote);
+        }
+        if (wrote != buf[i].used)
+        {
+          printf("Can't write %lu bytes to %s\n", (unsigned long)buf[i].used, dest);
+          goto copyfailed;
+        }
+        copied += buf[i].used;
       }
-    } while (copied < filesize);
-
-    freeBlock(buffer);
+    } while (!eof);
+    freeCopyBuffers(buf, nbuf);
   }
- #endif /* simple copy loop */
+
+  /* source may have changed size since we looked, trim any excess */
+  if (copied != size)
+    setFileSize(fdout, copied);
 
   /* reduce disk swap on single drives, close file on drive last accessed 1st */
 
@@ -381,8 +924,20 @@ BOOL copy(const BYTE *source, COUNT drive, const BYTE * filename)
   close(fdin);
 
 
-  printf("%lu Bytes transferred\n", copied);
+  elapsed = TICKS_TO_MS(getTicks() - start);
+  printTransferred(copied, crc, elapsed);
+  opts->written += copied;
+  spaceUsed(drive, copied, replaced);
+  reportExtents(drive, filename, dest);
 
+  if (opts->verify)
+    return verifyFile(drive, filename, copied, crc);
   return TRUE;
-} /* copy */
 
+copyfailed:
+  freeCopyBuffers(buf, nbuf);
+  close(fdout);
+  unlink(dest);
+  close(fdin);
+  return FALSE;
+} /* copy */
@@ -0,0 +1,104 @@
+/***************************************************************
+
+                                    crc32.c
+                                    DOS-C
+
+                            sys utility for DOS-C
+
+                             Copyright (c) 1991
+                             Pasquale J. Villani
+                             All Rights Reserved
+
+ This file is part of DOS-C.
+
+ DOS-C is free software; you can redistribute it and/or modify it under the
+ terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ DOS-C is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ details.
+
+ You should have received a copy of the GNU General Public License along with
+ DOS-C; see the file COPYING.  If not, write to the Free Software Foundation,
+ 675 Mass Ave, Cambridge, MA 02139, USA.
+
+***************************************************************/
+
+/* CRC-32 as used by zip, ethernet, etc. (reflected polynomial 0xEDB88320),
+   computed 4 bytes at a time using the slice-by-4 method.  The tables
+   are built on first use instead of stored, saving 4KB of executable.
+   The 32 bit state is handled as two 16 bit halves so 8086 builds need
+   no long shifts in the inner loop.
+*/
+
+#include "sys.h"
+#include "diskio.h"
+
+#define CRC32_POLY 0xEDB88320UL
+
+static ULONG crcTable[4][256];
+static BOOL crcReady = FALSE;
+
+static void makeCRCTable(void)
+{
+  ULONG c;
+  unsigned n, k;
+
+  for (n = 0; n < 256; n++)
+  {
+    c = n;
+    for (k = 0; k < 8; k++)
+      c = (c & 1) ? (c >> 1) ^ CRC32_POLY : (c >> 1);
+    crcTable[0][n] = c;
+  }
+
+  /* table k gives effect of byte followed by k zero bytes */
+  for (n = 0; n < 256; n++)
+  {
+    c = crcTable[0][n];
+    for (k = 1; k < 4; k++)
+    {
+      c = crcTable[0][(unsigned)c & 0xff] ^ (c >> 8);
+      crcTable[k][n] = c;
+    }
+  }
+  crcReady = TRUE;
+}
+
+/* updates (inverted) crc over a run that does not cross a segment */
+static ULONG crcRun(ULONG crc, UBYTE FAR *p, unsigned len)
+{
+  UWORD lo, hi;
+
+  for (; len >= 4; len -= 4, p += 4)
+  {
+    lo = loword(crc) ^ MK_UWORD(p[1], p[0]);
+    hi = hiword(crc) ^ MK_UWORD(p[3], p[2]);
+    crc = crcTable[3][lo & 0xff] ^ crcTable[2][lo >> 8] ^
+          crcTable[1][hi & 0xff] ^ crcTable[0][hi >> 8];
+  }
+  for (; len; len--, p++)
+    crc = crcTable[0][(loword(crc) ^ *p) & 0xff] ^ (crc >> 8);
+
+  return crc;
+}
+
+ULONG updateCRC32(ULONG crc, BYTE FAR *buf, ULONG len)
+{
+  ULONG done = 0;
+
+  if (!crcReady)
+    makeCRCTable();
+
+  crc ^= 0xFFFFFFFFUL;
+  while (done < len)
+  {
+    unsigned run = (len - done > HUGE_CHUNK) ? HUGE_CHUNK : (unsigned)(len - done);
+
+    crc = crcRun(crc, (UBYTE FAR *)hugeAdd(buf, done), run);
+    done += run;
+  }
+  return crc ^ 0xFFFFFFFFUL;
+}
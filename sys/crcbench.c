@@ -0,0 +1,78 @@
+/***************************************************************
+
+                                    crcbench.c
+                                    DOS-C
+
+                            sys utility for DOS-C
+
+                             Copyright (c) 1991
+                             Pasquale J. Villani
+                             All Rights Reserved
+
+ This file is part of DOS-C.
+
+ DOS-C is free software; you can redistribute it and/or modify it under the
+ terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ DOS-C is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ details.
+
+ You should have received a copy of the GNU General Public License along with
+ DOS-C; see the file COPYING.  If not, write to the Free Software Foundation,
+ 675 Mass Ave, Cambridge, MA 02139, USA.
+
+***************************************************************/
+
+
+/* CRC-32 throughput, small enough to build and run on the DOS target
+   so the cost of updateCRC32() per MB copied can be measured on 8086
+   and 386 class machines (wmake XCPU=86 crcbench.com, or XCPU=386).
+   A 64KB far buffer is checksummed until at least 2 seconds have
+   passed, as BIOS ticks are 55ms apart, then the rate is printed.
+   The host build (make crcbench) times the same loop in milliseconds.
+*/
+
+#include "sys.h"
+#include "diskio.h"
+
+BYTE pgm[] = "CRCBENCH";
+
+#define CRC_BLOCK 0x10000UL     /* bytes checksummed per call */
+#define CRC_MIN_MS 2000UL       /* shortest run timed */
+
+int main(void)
+{
+  BYTE FAR *buf = allocBlock(CRC_BLOCK);
+  ULONG crc = 0, kb = 0, start, ms, perMB;
+  unsigned i;
+
+  if (buf == NULL)
+  {
+    printf("%s: not enough memory\n", pgm);
+    return 1;
+  }
+  for (i = 0; i < (unsigned)(CRC_BLOCK / sizeof(UWORD)); i++)
+    ((UWORD FAR *)buf)[i] = (UWORD)(i * 0x9E37U);
+
+  /* builds tables outside the timed loop */
+  updateCRC32(0, buf, 1);
+
+  start = getTicks();
+  do
+  {
+    crc = updateCRC32(crc, buf, CRC_BLOCK);
+    kb += CRC_BLOCK >> 10;
+    ms = TICKS_TO_MS(getTicks() - start);
+  } while (ms < CRC_MIN_MS);
+
+  perMB = ms * 10240 / kb;      /* tenths of a millisecond */
+  printf("CRC-32 %08lX: %lu KB in %lu ms, %lu KB/s, %lu.%lu ms per MB\n",
+         (unsigned long)crc, (unsigned long)kb, (unsigned long)ms,
+         (unsigned long)(kb / ms * 1000 + kb % ms * 1000 / ms),
+         (unsigned long)(perMB / 10), (unsigned long)(perMB % 10));
+  freeBlock(buf);
+  return 0;
+}
@@ -36,16 +36,55 @@ int write(int fd, const void *buf, unsigned count);
 #define close _dos_close
 int unlink(const char *pathname);
 long lseek(int handle, long offset, int origin ); 
+#ifndef SEEK_SET
+#define SEEK_SET 0
+#endif
 #ifndef SEEK_END
 #define SEEK_END 2
 #endif
 #endif
 
 
-int MyAbsReadWrite(int DosDrive, int count, ULONG sector, void *buffer, int write);
+int MyAbsReadWrite(int DosDrive, int count, ULONG sector, void FAR *buffer, int write);
 
 void lockDrive(unsigned drive);
 void unLockDrive(unsigned drive);
+/* flush DOS buffers and force drive to be reread on next access */
+void reset_drive(int DosDrive);
+
+/* write-back sector cache (blockio.c), use cacheReadWrite() in place of
+   MyAbsReadWrite(); dirty sectors are written by flushCache(), which
+   unLockDrive() and exit do, sorted with adjacent sectors merged into
+   multi-sector transfers; invalidateCache() before DOS writes drive */
+int cacheReadWrite(int drive, int count, ULONG sector, void FAR *buffer, int write);
+void cacheTrackSize(unsigned drive, unsigned sectors);  /* runs don't cross tracks, 0 = any */
+BOOL flushCache(unsigned drive);
+void invalidateCache(unsigned drive);
+extern ULONG ioRequests, ioTransfers;   /* sectors requested, transfers made */
+
+/* groups raw accesses so drive is locked and reset only once (blockio.c),
+   may be nested, only outermost pair calls lockDrive()/unLockDrive() */
+void beginDriveAccess(unsigned drive);
+void endDriveAccess(unsigned drive);
+extern ULONG driveLocks;                /* times a drive was locked */
+extern unsigned cacheSectors;           /* size of cache, 0 if none */
+extern ULONG cacheHits, cacheMisses;    /* sectors read from cache, from disk */
+extern ULONG cacheWrites, cacheWritten; /* sectors written to cache, to disk */
+
+/* I/O statistics (stats.c), operation timed from start = getTicks() taken
+   before it; statFile() bytes is (ULONG)-1 if operation failed */
+enum {STAT_SECREAD, STAT_SECWRITE, STAT_LOCK, STAT_UNLOCK,
+      STAT_OPEN, STAT_READ, STAT_WRITE, STAT_STAT, STAT_OPS};
+#ifdef WITHSTATS
+void startStats(const char *traceFile, BOOL show);
+void statDisk(int op, ULONG start, unsigned drive, ULONG sector, unsigned count);
+void statFile(int op, ULONG start, const char *name, ULONG bytes);
+int timedStat(const char *path, struct stat *statbuf);
+#else
+#define statDisk(op, start, drive, sector, count)
+#define statFile(op, start, name, bytes)
+#define timedStat stat
+#endif
 
 /* returns default BPB (and other device parameters) */
 int getDeviceParms(unsigned drive, FileSystem fs, unsigned char *buffer);
@@ -59,6 +98,54 @@ BOOL haveLBA(void);     /* return TRUE if we have LBA BIOS, FALSE otherwise */
 /* return canonical (full) name */
 void truename(char *dest, const char *src);
 
+/* huge buffers, far memory blocks which may exceed 64KB (huge.c) */
+#define HUGE_CHUNK 0xFE00       /* largest single run, 127 sectors */
+BYTE FAR *allocBlock(ULONG memsize);
+void freeBlock(BYTE FAR *ptr);
+ULONG availBlock(void);         /* largest block allocBlock() can provide */
+#if defined _WIN32 || defined __unix__
+#define hugeAdd(ptr, bytes) ((ptr) + (bytes))
+#else
+BYTE FAR *hugeAdd(BYTE FAR *ptr, ULONG bytes);
+#endif
+/* bulk transfers, return bytes transferred or (ULONG)-1 on error */
+ULONG hugeRead(int fd, BYTE FAR *buf, ULONG len);
+ULONG hugeWrite(int fd, BYTE FAR *buf, ULONG len);
+void hugeMove(BYTE FAR *dst, BYTE FAR *src, ULONG len);
+
+/* CRC-32 (IEEE 802.3) of len bytes continuing from crc, 0 to start (crc32.c) */
+ULONG updateCRC32(ULONG crc, BYTE FAR *buf, ULONG len);
+
+/* sets size of open file in one step (preallocating its clusters),
+   file position is left at start; FALSE if not supported or no space */
+BOOL setFileSize(int fd, ULONG size);
+
+/* returns free running timer count, use TICKS_TO_MS() to convert elapsed */
+ULONG getTicks(void);
+#if defined _WIN32 || defined __unix__
+#define TICKS_TO_MS(ticks) (ticks)
+#else
+#define TICKS_TO_MS(ticks) ((ticks) * 55UL) /* BIOS timer, 18.2 per second */
+#endif
+
+#ifdef __unix__
+#define DIRECT_ALIGN 4096       /* allocBlock() alignment, suits direct I/O */
+void setDirectIO(BOOL on);      /* open images and devices with O_DIRECT */
+void setGeometry(unsigned heads, unsigned sectors);  /* used instead of guessing */
+BOOL haveGeometry(void);                /* TRUE once setGeometry() called */
+/* drive letters stand for host paths, by default the current directory;
+   a path that is not a directory is a disk image or block device */
+void setDrivePath(unsigned drive, const char *path);
+const char *drivePath(unsigned drive);
+BOOL isImageDrive(unsigned drive);
+unsigned mapDrive(const char *path);  /* returns drive assigned, 0xFF if none */
+/* image writes complete in the background, this waits for them and has
+   all images written to disk; FALSE if any failed, see driveFailed() */
+BOOL syncDrives(void);
+BOOL driveFailed(unsigned drive);
+long filelength(int fd);
+#endif
+
 #if defined __WATCOMC__ && defined __DOS__
 #pragma aux haveLBA =  \
       "mov ax, 0x4100"  /* IBM/MS Int 13h Extensions - installation check */ \
@@ -85,6 +172,24 @@ void truename(char *dest, const char *src);
       modify [ax bx cx dx] \
       value [dx ax];
 
+long filelength(int __handle);
+#pragma aux filelength = \
+      "mov ax, 0x4202" \
+      "xor cx, cx" \
+      "xor dx, dx" \
+      "int 0x21" \
+      "push ax" \
+      "push dx" \
+      "mov ax, 0x4200" \
+      "xor cx, cx" \
+      "xor dx, dx" \
+      "int 0x21" \
+      "pop dx" \
+      "pop ax" \
+      parm [bx] \
+      modify [cx] \
+      value [dx ax];
+
 /* return canonical (full) name */
 void truename(char *dest, const char *src);
 #pragma aux truename =  \
@@ -29,7 +29,6 @@
 #include "sys.h"
 #include "diskio.h"
 
-void reset_drive(int DosDrive);
 int generic_block_ioctl(unsigned drive, unsigned cx, unsigned char *par);
 
 
@@ -126,7 +125,7 @@ int fat32readwrite(int DosDrive, void *diskReadPacket, unsigned intno)
 
 #endif
 
-int MyAbsReadWrite(int DosDrive, int count, ULONG sector, void *buffer,
+int MyAbsReadWrite(int DosDrive, int count, ULONG sector, void FAR *buffer,
                    int write)
 {
   struct {
@@ -239,6 +238,7 @@ void lockDrive(unsigned drive)
 
 void unLockDrive(unsigned drive)
 {
+  flushCache(drive);
   reset_drive(drive);
   generic_block_ioctl(drive + 1, 0x86a, NULL);
 }
@@ -247,3 +247,26 @@ int getDeviceParms(unsigned drive, FileSystem fs, unsigned char *buffer)
 {
   return generic_block_ioctl(drive + 1, (fs==FAT32)?0x4860:0x860, buffer);
 }
+
+/* returns BIOS timer tick count at 0040:006C */
+ULONG getTicks(void)
+{
+  return *(ULONG FAR *)MK_FP(0x40, 0x6c);
+}
+
+/* extends open file to size bytes in a single step, leaving the file
+   position at start; DOS allocates all clusters needed when 0 bytes
+   are written at a position beyond end of file */
+BOOL setFileSize(int fd, ULONG size)
+{
+  union REGS regs;
+
+  if ((ULONG)lseek(fd, size, SEEK_SET) != size)
+    return FALSE;
+  regs.h.ah = 0x40;  /* write 0 bytes, sets file size to current position */
+  regs.x.bx = fd;
+  regs.x.cx = 0;
+  intdos(&regs, &regs);
+  lseek(fd, 0, SEEK_SET);
+  return !regs.x.cflag;
+}
@@ -0,0 +1,868 @@
+/***************************************************************
+
+                                    diskio_p.c
+                                    DOS-C
+
+                            sys utility for DOS-C
+
+                             Copyright (c) 1991
+                             Pasquale J. Villani
+                             All Rights Reserved
+
+ This file is part of DOS-C.
+
+ DOS-C is free software; you can redistribute it and/or modify it under the
+ terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ DOS-C is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ details.
+
+ You should have received a copy of the GNU General Public License along with
+ DOS-C; see the file COPYING.  If not, write to the Free Software Foundation,
+ 675 Mass Ave, Cambridge, MA 02139, USA.
+
+***************************************************************/
+
+/* host (POSIX) support so sys can be built and run on Linux etc.
+   Each drive letter stands for a host path: either a directory files
+   are copied into, or a raw disk image file or block device holding a
+   FAT volume.  Image files are mapped into memory so sectors are just
+   copied to and from the mapping, written back by msync when closed;
+   devices (or images that can't be mapped) use pread/pwrite.
+   Their writes are asynchronous: the data is copied and queued for a
+   small pool of threads, so writes complete out of order while sys
+   carries on (with /DRIVES, on to the next image).  A write waits only
+   for earlier queued writes it overlaps, a read for queued writes to
+   the sectors it reads.  syncDrives() is the barrier, it waits for all
+   writes then has every open image flushed to disk at once.
+   A drive may also be a single partition of an image or device, given
+   as path:N, found from its MBR (N>4 for logical partitions) or GPT;
+   sectors are then relative to the start of the partition.
+   With /DIRECT images and devices are opened for direct I/O (O_DIRECT)
+   bypassing the host's page cache; transfers must then be whole blocks
+   from aligned memory, those that aren't go through a bounce buffer.
+   Drive geometry, for the BPB, is what the kernel reports for devices;
+   for images, or devices without any, it is as given by /GEOMETRY, else
+   as used by the partition table, else as BIOS LBA assist would give.
+*/
+
+#ifdef __linux__
+#define _GNU_SOURCE             /* for O_DIRECT */
+#endif
+#include "sys.h"
+#include "diskio.h"
+#include "fatio.h"
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <linux/hdreg.h>
+#include <linux/fs.h>
+#endif
+
+#define FLOPPY_MAX 2949120UL    /* largest image treated as a floppy, 2.88MB */
+#define MBR_TABLE  0x1be        /* partition table in MBR and each EBR */
+#define MBR_GPT    0xee         /* type of protective MBR entry on GPT disks */
+#define MAX_LOGICAL 128         /* guards against loops in EBR chain */
+#define isExtended(type) ((type) == 0x05 || (type) == 0x0f || (type) == 0x85)
+#define ASYNC_THREADS 4         /* threads doing queued writes */
+#define ASYNC_MAX  (16UL << 20) /* most bytes of queued writes */
+
+typedef struct {
+  const char *path;             /* host path drive stands for, NULL if none */
+  char *file;                   /* image holding partition, NULL if whole */
+  unsigned long long start;     /* 1st sector of partition within file */
+  unsigned long long sectors;   /* sectors in partition, 0 if whole file */
+  int fd;                       /* open image or device, 0 if not yet */
+  BOOL image;                   /* path is an image or device, not directory */
+  BOOL readOnly;                /* could only be opened for reading */
+  UBYTE *map;                   /* whole image mapped, NULL if not */
+  size_t mapSize;
+  UBYTE writeFailed;            /* a queued write (or flush) failed, 2 once reported */
+  unsigned blockSize;           /* alignment for direct I/O, 0 if not direct */
+  dev_t dev;                    /* file or device mapped, to spot it given */
+  ino_t ino;                    /*  again under another name, ino 0 if unset */
+} HostDrive;
+
+static HostDrive drives[26];
+static BOOL closeRegistered = FALSE;
+static BOOL directIO = FALSE;   /* /DIRECT given */
+static UWORD userHeads = 0, userSectors = 0;  /* /GEOMETRY, 0 if not given */
+
+/* a queued write, or if bytes is 0 a flush of the image to disk */
+typedef struct AsyncWrite {
+  struct AsyncWrite *next;
+  unsigned drive;
+  off_t offset;
+  size_t bytes;
+  BOOL busy;                    /* being done by a thread */
+  UBYTE *data;
+} AsyncWrite;
+
+static pthread_mutex_t asyncLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t asyncWork = PTHREAD_COND_INITIALIZER;  /* job queued */
+static pthread_cond_t asyncDone = PTHREAD_COND_INITIALIZER;  /* job finished */
+static AsyncWrite *pending = NULL;      /* in order queued, until finished */
+static size_t pendingBytes = 0;
+static int asyncThreads = 0;            /* started, -1 if none could be */
+
+/* TRUE if job w must wait for, or a read of drive offset..offset+bytes
+   must wait for, job p; flushes overlap everything on their drive */
+static BOOL overlaps(AsyncWrite *p, unsigned drive, off_t offset, size_t bytes)
+{
+  return p->drive == drive && (!p->bytes || !bytes ||
+         (offset < p->offset + (off_t)p->bytes && p->offset < offset + (off_t)bytes));
+}
+
+/* 1st queued job not held back by an earlier one, called with lock held */
+static AsyncWrite *nextJob(void)
+{
+  AsyncWrite *w, *p;
+
+  for (w = pending; w != NULL; w = w->next)
+  {
+    if (w->busy)
+      continue;
+    for (p = pending; p != w && !overlaps(p, w->drive, w->offset, w->bytes); p = p->next)
+      ;
+    if (p == w)
+      return w;
+  }
+  return NULL;
+}
+
+/* does job, returns TRUE if successful */
+static BOOL doJob(AsyncWrite *w)
+{
+  HostDrive *d = &drives[w->drive];
+
+  if (w->bytes)
+    return pwrite(d->fd, w->data, w->bytes, w->offset) == (ssize_t)w->bytes;
+  if (d->map != NULL && msync(d->map, d->mapSize, MS_SYNC) != 0)
+    return FALSE;
+  return fsync(d->fd) == 0 || errno == EINVAL;  /* EINVAL if can't be synced */
+}
+
+static void *asyncWorker(void *arg)
+{
+  AsyncWrite *w, **link;
+  BOOL ok;
+
+  pthread_mutex_lock(&asyncLock);
+  for (;;)
+  {
+    if ((w = nextJob()) == NULL)
+    {
+      pthread_cond_wait(&asyncWork, &asyncLock);
+      continue;
+    }
+    w->busy = TRUE;
+    pthread_mutex_unlock(&asyncLock);
+    ok = doJob(w);
+    pthread_mutex_lock(&asyncLock);
+
+    if (!ok)
+      drives[w->drive].writeFailed = 1;
+    for (link = &pending; *link != w; link = &(*link)->next)
+      ;
+    *link = w->next;
+    pendingBytes -= w->bytes;
+    free(w->data);
+    free(w);
+    /* jobs it held back may now be done */
+    pthread_cond_broadcast(&asyncWork);
+    pthread_cond_broadcast(&asyncDone);
+  }
+  return NULL;
+}
+
+/* queues job, or does it now if no threads; data (if any) is copied */
+static void queueJob(unsigned drive, off_t offset, const void *data, size_t bytes)
+{
+  AsyncWrite *w, **link;
+
+  pthread_mutex_lock(&asyncLock);
+  if (asyncThreads == 0)
+  {
+    pthread_t thread;
+
+    while (asyncThreads < ASYNC_THREADS &&
+           pthread_create(&thread, NULL, asyncWorker, NULL) == 0)
+    {
+      pthread_detach(thread);
+      asyncThreads++;
+    }
+    if (asyncThreads == 0)
+      asyncThreads = -1;
+  }
+
+  w = malloc(sizeof(AsyncWrite));
+  if (w != NULL && bytes && posix_memalign((void **)&w->data, DIRECT_ALIGN, bytes) != 0)
+  {
+    free(w);
+    w = NULL;
+  }
+  if (asyncThreads < 0 || w == NULL)
+  {
+    AsyncWrite job;
+
+    /* synchronously, once earlier writes it overlaps are done */
+    while (pending != NULL && asyncThreads > 0)
+      pthread_cond_wait(&asyncDone, &asyncLock);
+    pthread_mutex_unlock(&asyncLock);
+    job.drive = drive;
+    job.offset = offset;
+    job.bytes = bytes;
+    job.data = (UBYTE *)data;
+    if (!doJob(&job))
+      drives[drive].writeFailed = 1;
+    free(w);
+    return;
+  }
+
+  /* bound memory held by queued data */
+  while (pending != NULL && pendingBytes + bytes > ASYNC_MAX)
+    pthread_cond_wait(&asyncDone, &asyncLock);
+  w->next = NULL;
+  w->drive = drive;
+  w->offset = offset;
+  w->bytes = bytes;
+  w->busy = FALSE;
+  if (bytes)
+    memcpy(w->data, data, bytes);
+  else
+    w->data = NULL;
+  for (link = &pending; *link != NULL; link = &(*link)->next)
+    ;
+  *link = w;
+  pendingBytes += bytes;
+  pthread_cond_signal(&asyncWork);
+  pthread_mutex_unlock(&asyncLock);
+}
+
+/* waits until queued jobs for drive overlapping offset..offset+bytes (all
+   of them if bytes is 0) are done */
+static void waitWrites(unsigned drive, off_t offset, size_t bytes)
+{
+  AsyncWrite *p;
+
+  pthread_mutex_lock(&asyncLock);
+  for (;;)
+  {
+    for (p = pending; p != NULL && !overlaps(p, drive, offset, bytes); p = p->next)
+      ;
+    if (p == NULL)
+      break;
+    pthread_cond_wait(&asyncDone, &asyncLock);
+  }
+  pthread_mutex_unlock(&asyncLock);
+}
+
+/* writes out and closes image of drive */
+static void closeDrive(HostDrive *d)
+{
+  waitWrites((unsigned)(d - drives), 0, 0);
+  if (d->map != NULL)
+  {
+    msync(d->map, d->mapSize, MS_SYNC);
+    munmap(d->map, d->mapSize);
+    d->map = NULL;
+  }
+  if (d->fd > 0)
+  {
+    fsync(d->fd);
+    close(d->fd);
+  }
+  d->fd = 0;
+}
+
+/* writes out and closes all open images, called at exit */
+static void closeDrives(void)
+{
+  int i;
+
+  syncDrives();
+  for (i = 0; i < 26; i++)
+    closeDrive(&drives[i]);
+}
+
+/* waits for queued writes to all drives to complete, then flushes every
+   open image to disk, all at the same time; returns FALSE (reporting
+   which the first time) if writing to any image failed */
+BOOL syncDrives(void)
+{
+  BOOL ok = TRUE;
+  int i;
+
+  for (i = 0; i < 26; i++)
+  {
+    if (drives[i].fd > 0 && !drives[i].readOnly)
+    {
+      flushCache(i);  /* may run before cache's own exit handler */
+      queueJob(i, 0, NULL, 0);
+    }
+  }
+  for (i = 0; i < 26; i++)
+  {
+    waitWrites(i, 0, 0);
+    if (drives[i].writeFailed == 1)
+      printf("%s: failed writing to image %s\n", pgm, drives[i].path);
+    if (drives[i].writeFailed)
+    {
+      drives[i].writeFailed = 2;
+      ok = FALSE;
+    }
+  }
+  return ok;
+}
+
+/* TRUE if a write to drive failed, known once syncDrives() done */
+BOOL driveFailed(unsigned drive)
+{
+  return drives[drive].writeFailed != 0;
+}
+
+void setDrivePath(unsigned drive, const char *path)
+{
+  struct stat st;
+
+  closeDrive(&drives[drive]);
+  free(drives[drive].file);
+  drives[drive].file = NULL;
+  drives[drive].start = drives[drive].sectors = 0;
+  drives[drive].path = path;
+  drives[drive].readOnly = FALSE;
+  drives[drive].writeFailed = 0;
+  drives[drive].ino = 0;
+  drives[drive].image = path != NULL && stat(path, &st) == 0 && !S_ISDIR(st.st_mode);
+}
+
+const char *drivePath(unsigned drive)
+{
+  return drives[drive].path ? drives[drive].path : ".";
+}
+
+BOOL isImageDrive(unsigned drive)
+{
+  return drives[drive].image;
+}
+
+static BOOL readSector(int fd, unsigned long long sector, UBYTE *buffer)
+{
+  return pread(fd, buffer, SEC_SIZE, (off_t)(sector * SEC_SIZE)) == SEC_SIZE;
+}
+
+/* little endian fields of partition tables */
+static ULONG getLong(const UBYTE *p)
+{
+  return p[0] | ((ULONG)p[1] << 8) | ((ULONG)p[2] << 16) | ((ULONG)p[3] << 24);
+}
+
+static unsigned long long getLongLong(const UBYTE *p)
+{
+  return getLong(p) | ((unsigned long long)getLong(p + 4) << 32);
+}
+
+/* looks up entry number (1 based) of GUID partition table */
+static BOOL findGPTPartition(int fd, unsigned number,
+                             unsigned long long *start, unsigned long long *sectors)
+{
+  UBYTE sector[SEC_SIZE];
+  UBYTE *entry;
+  ULONG count, size, perSector;
+  unsigned i;
+
+  if (!readSector(fd, 1, sector) || memcmp(sector, "EFI PART", 8) != 0)
+    return FALSE;
+  count = getLong(sector + 80);
+  size = getLong(sector + 84);
+  if (number > count || size < 128 || size > SEC_SIZE || SEC_SIZE % size)
+    return FALSE;
+  perSector = SEC_SIZE / size;
+  if (!readSector(fd, getLongLong(sector + 72) + (number - 1) / perSector, sector))
+    return FALSE;
+  entry = sector + ((number - 1) % perSector) * size;
+
+  /* unused entries have an all zero partition type GUID */
+  for (i = 0; i < 16 && entry[i] == 0; i++)
+    ;
+  if (i == 16)
+    return FALSE;
+  *start = getLongLong(entry + 32);
+  *sectors = getLongLong(entry + 40) - *start + 1;
+  return TRUE;
+}
+
+/* finds partition number of disk, 1-4 are MBR primary partitions and 5
+   on logical ones in the extended partition's chain of EBRs, as Linux
+   numbers them; GPT disks are numbered by their partition entries */
+static BOOL findPartition(int fd, unsigned number,
+                          unsigned long long *start, unsigned long long *sectors)
+{
+  UBYTE sector[SEC_SIZE];
+  UBYTE *entry;
+  ULONG extStart, ebr;
+  unsigned i, n;
+
+  if (number == 0 || !readSector(fd, 0, sector) ||
+      sector[510] != 0x55 || sector[511] != 0xaa)
+    return FALSE;
+  for (i = 0; i < 4; i++)
+    if (sector[MBR_TABLE + i * 16 + 4] == MBR_GPT)
+      return findGPTPartition(fd, number, start, sectors);
+
+  if (number <= 4)
+  {
+    entry = sector + MBR_TABLE + (number - 1) * 16;
+    if (entry[4] == 0 || isExtended(entry[4]))
+      return FALSE;
+    *start = getLong(entry + 8);
+    *sectors = getLong(entry + 12);
+    return TRUE;
+  }
+
+  for (i = 0; i < 4 && !isExtended(sector[MBR_TABLE + i * 16 + 4]); i++)
+    ;
+  if (i == 4)
+    return FALSE;
+  extStart = ebr = getLong(sector + MBR_TABLE + i * 16 + 8);
+  for (n = 5; n < 5 + MAX_LOGICAL; n++)
+  {
+    if (!readSector(fd, ebr, sector) || sector[510] != 0x55 || sector[511] != 0xaa)
+      return FALSE;
+    /* 1st entry is the logical partition, relative to this EBR */
+    entry = sector + MBR_TABLE;
+    if (n == number)
+    {
+      if (entry[4] == 0)
+        return FALSE;
+      *start = (unsigned long long)ebr + getLong(entry + 8);
+      *sectors = getLong(entry + 12);
+      return TRUE;
+    }
+    /* 2nd entry links to next EBR, relative to extended partition */
+    entry += 16;
+    if (!isExtended(entry[4]))
+      return FALSE;
+    ebr = extStart + getLong(entry + 8);
+  }
+  return FALSE;
+}
+
+/* assigns a drive letter to host path, A: or B: for floppy sized images
+   (or C: onwards if both taken) otherwise the next from C:, returns 0xFF
+   if none are left or path:N given and there is no partition N; a path
+   naming the same file (and partition) as an earlier one gets its drive */
+unsigned mapDrive(const char *path)
+{
+  struct stat st;
+  unsigned drive = 2, number = 0;
+  const char *colon = strrchr(path, ':');
+  char *file = NULL;
+  unsigned long long start = 0, sectors = 0;
+  BOOL found;
+
+  if ((found = stat(path, &st) == 0) != FALSE)
+  {
+    if (S_ISREG(st.st_mode) && st.st_size <= (off_t)FLOPPY_MAX)
+      drive = 0;
+  }
+  else if (colon != NULL && colon[1] && colon[strspn(colon + 1, "0123456789") + 1] == '\0')
+  {
+    int fd;
+
+    /* partition of image or device, never a floppy */
+    number = atoi(colon + 1);
+    file = strdup(path);
+    file[colon - path] = '\0';
+    if ((fd = open(file, O_RDONLY)) < 0 || !findPartition(fd, number, &start, &sectors))
+    {
+      printf("%s: can't find partition %u of %s\n", pgm, number, file);
+      if (fd >= 0)
+        close(fd);
+      free(file);
+      return 0xFF;
+    }
+    close(fd);
+    found = stat(file, &st) == 0;
+  }
+
+  if (found)
+  {
+    unsigned i;
+
+    for (i = 0; i < 26; i++)
+    {
+      if (drives[i].ino != 0 && drives[i].dev == st.st_dev &&
+          drives[i].ino == st.st_ino && drives[i].start == start)
+      {
+        free(file);
+        return i;
+      }
+    }
+  }
+
+  for (; drive < 26; drive++)
+  {
+    if (drives[drive].path == NULL)
+    {
+      setDrivePath(drive, path);
+      if (found)
+      {
+        drives[drive].dev = st.st_dev;
+        drives[drive].ino = st.st_ino;
+      }
+      if (file != NULL)
+      {
+        drives[drive].file = file;
+        drives[drive].image = TRUE;
+        drives[drive].start = start;
+        drives[drive].sectors = sectors;
+      }
+      return drive;
+    }
+  }
+  free(file);
+  return 0xFF;
+}
+
+/* maps all of an image file, if not possible pread/pwrite are used */
+static void mapImage(HostDrive *d)
+{
+  struct stat st;
+  void *map;
+
+  if (d->blockSize || fstat(d->fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+      (unsigned long long)st.st_size != (size_t)st.st_size)
+    return;
+  map = mmap(NULL, (size_t)st.st_size, PROT_READ | (d->readOnly ? 0 : PROT_WRITE),
+             MAP_SHARED, d->fd, 0);
+  if (map == MAP_FAILED)
+    return;
+  d->map = map;
+  d->mapSize = (size_t)st.st_size;
+}
+
+void setDirectIO(BOOL on)
+{
+  directIO = on;
+}
+
+/* returns smallest block direct I/O on fd allows, 0 if none does: the
+   logical sector size of a device, else found by trying reads */
+static unsigned directBlockSize(int fd)
+{
+  UBYTE *buffer;
+  unsigned size = 0, tried;
+
+#ifdef BLKSSZGET
+  int logical;
+
+  if (ioctl(fd, BLKSSZGET, &logical) == 0)
+    return (logical >= SEC_SIZE && logical <= DIRECT_ALIGN &&
+            (logical & (logical - 1)) == 0) ? (unsigned)logical : 0;
+#endif
+  if (posix_memalign((void **)&buffer, DIRECT_ALIGN, DIRECT_ALIGN) != 0)
+    return 0;
+  for (tried = SEC_SIZE; tried <= DIRECT_ALIGN && !size; tried *= 2)
+    if (pread(fd, buffer, tried, 0) == (ssize_t)tried)
+      size = tried;
+  free(buffer);
+  return size;
+}
+
+/* opens image with flags, for direct I/O if wanted and the host allows
+   it (tmpfs for one may refuse O_DIRECT), sets blockSize accordingly */
+static int openImage(HostDrive *d, const char *file, int flags)
+{
+  int fd;
+
+  d->blockSize = 0;
+#ifdef O_DIRECT
+  if (directIO && (fd = open(file, flags | O_DIRECT)) >= 0)
+  {
+    if ((d->blockSize = directBlockSize(fd)) != 0)
+      return fd;
+    close(fd);
+  }
+#endif
+  return open(file, flags);
+}
+
+/* returns descriptor for image of drive, opening it on first use */
+static int driveFd(unsigned drive, int write)
+{
+  HostDrive *d = &drives[drive];
+
+  if (!d->image)
+    return -1;
+  if (d->fd <= 0)
+  {
+    const char *file = d->file ? d->file : d->path;
+
+    if ((d->fd = openImage(d, file, O_RDWR)) < 0)
+    {
+      d->fd = openImage(d, file, O_RDONLY);
+      d->readOnly = TRUE;
+    }
+    if (d->fd < 0)
+    {
+      printf("%s: can't open image %s: %s\n", pgm, d->path, strerror(errno));
+      d->fd = 0;
+      return -1;
+    }
+    mapImage(d);
+    if (!closeRegistered)
+      closeRegistered = atexit(closeDrives) == 0;
+  }
+  if (write && d->readOnly)
+    return -1;
+  return d->fd;
+}
+
+
+/* direct I/O of bytes at offset, done through an aligned bounce buffer
+   of whole blocks if buffer, offset, or bytes are not aligned; reads
+   blocks only partly written first to keep the rest of them */
+static int directReadWrite(unsigned drive, off_t offset, UBYTE *buffer, size_t bytes, int write)
+{
+  HostDrive *d = &drives[drive];
+  size_t block = d->blockSize, mask = block - 1;
+  off_t start = offset & ~(off_t)mask;
+  size_t len = ((size_t)(offset - start) + bytes + mask) & ~mask;
+  UBYTE *bounce;
+  BOOL ok = TRUE;
+
+  if (start == offset && len == bytes && ((size_t)buffer & mask) == 0)
+  {
+    if (write)
+    {
+      queueJob(drive, offset, buffer, bytes);
+      return 0;
+    }
+    waitWrites(drive, offset, bytes);
+    return (pread(d->fd, buffer, bytes, offset) == (ssize_t)bytes) ? 0 : 0xFF;
+  }
+
+  if (posix_memalign((void **)&bounce, DIRECT_ALIGN, len) != 0)
+    return 0xFF;
+  waitWrites(drive, start, len);
+  if (!write)
+    ok = pread(d->fd, bounce, len, start) == (ssize_t)len;
+  else
+  {
+    if (start < offset)
+      ok = pread(d->fd, bounce, block, start) == (ssize_t)block;
+    if (ok && (size_t)(offset - start) + bytes < len && (len > block || start == offset))
+      ok = pread(d->fd, bounce + len - block, block, start + len - block) == (ssize_t)block;
+  }
+  if (ok && write)
+  {
+    memcpy(bounce + (offset - start), buffer, bytes);
+    queueJob(drive, start, bounce, len);
+  }
+  else if (ok)
+    memcpy(buffer, bounce + (offset - start), bytes);
+  free(bounce);
+  return ok ? 0 : 0xFF;
+}
+
+
+/* reads or writes count sectors at sector of drive's image,
+   returns 0 on success, nonzero on error as DOS does */
+int MyAbsReadWrite(int DosDrive, int count, ULONG sector, void FAR *buffer, int write)
+{
+  HostDrive *d = &drives[DosDrive];
+  int fd = driveFd(DosDrive, write);
+  UBYTE *map = d->map;
+  size_t bytes = (size_t)count * SEC_SIZE;
+  off_t offset = (off_t)(d->start + sector) * SEC_SIZE;
+  ssize_t done;
+
+  /* never stray outside partition */
+  if (fd < 0 || (d->sectors && (unsigned long long)sector + count > d->sectors))
+    return 0xFF;
+  if (map != NULL && (size_t)offset + bytes <= drives[DosDrive].mapSize)
+  {
+    if (write)
+      memcpy(map + offset, buffer, bytes);
+    else
+      memcpy(buffer, map + offset, bytes);
+    return 0;
+  }
+  if (d->blockSize)
+    return directReadWrite(DosDrive, offset, buffer, bytes, write);
+  if (write)
+  {
+    queueJob(DosDrive, offset, buffer, bytes);
+    return 0;
+  }
+  waitWrites(DosDrive, offset, bytes);
+  done = pread(fd, buffer, bytes, offset);
+  return (done == (ssize_t)bytes) ? 0 : 0xFF;
+}
+
+/* host caches are coherent, nothing to flush */
+void reset_drive(int DosDrive) {}
+
+BOOL haveLBA(void)
+{
+  return TRUE;
+}
+
+/* sys is the only user of an image, nothing to lock */
+void lockDrive(unsigned drive) {}
+void unLockDrive(unsigned drive)
+{
+  flushCache(drive);
+}
+
+void setGeometry(unsigned heads, unsigned sectors)
+{
+  userHeads = (UWORD)heads;
+  userSectors = (UWORD)sectors;
+}
+
+BOOL haveGeometry(void)
+{
+  return userHeads != 0;
+}
+
+/* returns size in sectors of whole disk (device or image file) fd is */
+static unsigned long long diskSize(int fd)
+{
+  struct stat st;
+#ifdef BLKGETSIZE64
+  unsigned long long bytes;
+
+  if (ioctl(fd, BLKGETSIZE64, &bytes) == 0)
+    return bytes / SEC_SIZE;
+#endif
+  return fstat(fd, &st) == 0 ? (unsigned long long)st.st_size / SEC_SIZE : 0;
+}
+
+/* heads and sectors per track given by BIOS LBA assist translation for
+   a disk of size sectors: 63 sectors and the fewest heads (16, 32, 64,
+   128, or 255) that keep it within 1024 cylinders */
+static void lbaAssist(unsigned long long size, UWORD *heads, UWORD *sectors)
+{
+  unsigned h;
+
+  for (h = 16; h < 255 && size > 1024ULL * h * 63; h *= 2)
+    ;
+  *heads = (h > 255) ? 255 : h;
+  *sectors = 63;
+}
+
+/* heads and sectors per track the MBR's partition table was made for,
+   taken from an entry whose ending CHS address agrees with its LBA one */
+static BOOL mbrGeometry(int fd, UWORD *heads, UWORD *sectors)
+{
+  UBYTE *mbr = (UBYTE *)allocBlock(DIRECT_ALIGN);  /* fd may be direct */
+  const UBYTE *entry;
+  unsigned i, h, s, c;
+  BOOL found = FALSE;
+
+  if (mbr == NULL)
+    return FALSE;
+  if (pread(fd, mbr, DIRECT_ALIGN, 0) == DIRECT_ALIGN &&
+      mbr[510] == 0x55 && mbr[511] == 0xaa)
+  {
+    for (i = 0; i < 4 && !found; i++)
+    {
+      entry = mbr + MBR_TABLE + i * 16;
+      h = entry[5];
+      s = entry[6] & 63;
+      c = ((entry[6] & 0xc0) << 2) | entry[7];
+      if (entry[4] == 0 || entry[4] == MBR_GPT || s == 0 || c >= 1023)
+        continue;   /* unused, or end beyond what CHS can address */
+      found = ((unsigned long long)c * (h + 1) + h) * s + s - 1 ==
+              (unsigned long long)getLong(entry + 8) + getLong(entry + 12) - 1;
+      if (found)
+      {
+        *heads = (UWORD)(h + 1);
+        *sectors = (UWORD)s;
+      }
+    }
+  }
+  freeBlock((BYTE *)mbr);
+  return found;
+}
+
+/* returns default BPB (and other device parameters), the geometry
+   reported by the kernel for block devices, else as /GEOMETRY gives or
+   the partition table implies or LBA assist gives; the hidden sectors
+   are where the kernel or partition table says partition starts, else
+   as in image's BPB */
+int getDeviceParms(unsigned drive, FileSystem fs, unsigned char *buffer)
+{
+  /* BPB starts at byte 7 of buffer, less jump and OEM name fields */
+  struct bootsectortype *bpb = (struct bootsectortype *)(buffer + 7 - 11);
+  UBYTE bootsector[SEC_SIZE];
+  struct bootsectortype *bs = (struct bootsectortype *)bootsector;
+  int fd = driveFd(drive, 0);
+  UWORD heads = userHeads, sectors = userSectors;
+#ifdef HDIO_GETGEO
+  struct hd_geometry geo;
+#endif
+
+  if (fd < 0 || MyAbsReadWrite(drive, 1, 0, bootsector, 0) != 0)
+    return -1;
+  bpb->bsHiddenSecs = bs->bsHiddenSecs;
+
+#ifdef HDIO_GETGEO
+  if (!userHeads && ioctl(fd, HDIO_GETGEO, &geo) == 0 && geo.heads && geo.sectors)
+  {
+    heads = geo.heads;
+    sectors = geo.sectors;
+    if (geo.start)  /* device is a partition */
+      bpb->bsHiddenSecs = (ULONG)geo.start;
+  }
+  else
+#endif
+  if (!userHeads && (drives[drive].file == NULL || !mbrGeometry(fd, &heads, &sectors)))
+    lbaAssist(diskSize(fd), &heads, &sectors);
+  bpb->bsHeads = heads;
+  bpb->bsSecPerTrack = sectors;
+
+  /* partition's hidden sectors are where partition table places it */
+  if (drives[drive].file != NULL && drives[drive].start <= 0xFFFFFFFFUL)
+    bpb->bsHiddenSecs = (ULONG)drives[drive].start;
+  return 0;
+}
+
+/* returns milliseconds from an arbitrary starting point */
+ULONG getTicks(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ULONG)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/* sets size of open file, reserving its blocks where supported */
+BOOL setFileSize(int fd, ULONG size)
+{
+  BOOL ok = ftruncate(fd, (off_t)size) == 0;
+
+#ifdef __linux__
+  if (ok && size)
+    posix_fallocate(fd, 0, (off_t)size);
+#endif
+  lseek(fd, 0, SEEK_SET);
+  return ok;
+}
+
+long filelength(int fd)
+{
+  struct stat fstatbuf;
+
+  if (fstat(fd, &fstatbuf))
+    return -1;
+  return (long)fstatbuf.st_size;
+}
+
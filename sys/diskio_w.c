@@ -56,7 +56,7 @@ LocalFree( lpMsgBuf );
 /* See http://www.codeguru.com/system/ReadSector.html by Sreejith S
    to add Win9x support 
 */
-int MyAbsReadWrite(int DosDrive, int count, ULONG sector, void *buffer, int write)
+int MyAbsReadWrite(int DosDrive, int count, ULONG sector, void FAR *buffer, int write)
 //int MyAbsReadWrite(int DosDrive, UWORD count, ULONG sector, char *buffer, int write)
 {
   char devName[] = "\\\\.\\X:";
@@ -108,7 +108,10 @@ BOOL haveLBA(void)     /* return TRUE if we have LBA BIOS, FALSE otherwise */
 }
 
 void lockDrive(unsigned drive) {}
-void unLockDrive(unsigned drive) {}
+void unLockDrive(unsigned drive)
+{
+  flushCache(drive);
+}
 
 /* returns default BPB (and other device parameters) */
 int getDeviceParms(unsigned drive, FileSystem fs, unsigned char *buffer)
@@ -153,3 +156,15 @@ int getDeviceParms(unsigned drive, FileSystem fs, unsigned char *buffer)
   printf("Error obtaining drive %s geometry\n", drivename);
   return -1;    
 }
+
+/* returns milliseconds since system started */
+ULONG getTicks(void)
+{
+  return GetTickCount();
+}
+
+/* extends open file to size bytes in a single step */
+BOOL setFileSize(int fd, ULONG size)
+{
+  return _chsize(fd, (long)size) == 0;
+}
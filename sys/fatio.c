@@ -0,0 +1,478 @@
+/***************************************************************
+
+                                    fatio.c
+                                    DOS-C
+
+                            sys utility for DOS-C
+
+                             Copyright (c) 1991
+                             Pasquale J. Villani
+                             All Rights Reserved
+
+ This file is part of DOS-C.
+
+ DOS-C is free software; you can redistribute it and/or modify it under the
+ terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ DOS-C is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ details.
+
+ You should have received a copy of the GNU General Public License along with
+ DOS-C; see the file COPYING.  If not, write to the Free Software Foundation,
+ 675 Mass Ave, Cambridge, MA 02139, USA.
+
+***************************************************************/
+
+/* raw access to FAT and root directory of a FAT12/16/32 volume,
+   caller is responsible for locking the drive and having DOS
+   flush/reset its buffers before and after
+*/
+
+#include "sys.h"
+#include "diskio.h"
+#include "fatio.h"
+
+
+/* read BPB of drive and determine layout, FALSE if not a usable FAT volume */
+BOOL openVolume(FATVolume *vol, unsigned drive)
+{
+  UBYTE bootsector[SEC_SIZE];
+  struct bootsectortype *bs = (struct bootsectortype *)bootsector;
+  ULONG totalSectors, clusters;
+
+  memset(vol, 0, sizeof(FATVolume));
+  vol->drive = drive;
+  vol->fatSector = (ULONG)-1;
+
+  if (cacheReadWrite(drive, 1, 0, bootsector, 0) != 0)
+    return FALSE;
+  if (bs->bsBytesPerSec != SEC_SIZE || !bs->bsSecPerClust || !bs->bsFATs)
+    return FALSE;
+
+  /* see "FAT: General Overview of On-Disk Format" v1.02, 5.V.1999 */
+  vol->secPerClust = bs->bsSecPerClust;
+  vol->fats = bs->bsFATs;
+  vol->mirror = TRUE;
+  vol->fatStart = bs->bsResSectors;
+#ifdef WITHFAT32
+  vol->fatSize = bs->bsFATsecs ? bs->bsFATsecs
+                 : ((struct bootsectortype32 *)bs)->bsBigFatSize;
+#else
+  vol->fatSize = bs->bsFATsecs;
+#endif
+  totalSectors = bs->bsSectors ? bs->bsSectors : bs->bsHugeSectors;
+  vol->rootDirSectors = (bs->bsRootDirEnts * DIRENT_SIZE + SEC_SIZE - 1) / SEC_SIZE;
+  vol->rootSector = vol->fatStart + bs->bsFATs * vol->fatSize;
+  vol->dataStart = vol->rootSector + vol->rootDirSectors;
+  if (!vol->fatSize || totalSectors <= vol->dataStart)
+    return FALSE;
+  clusters = (totalSectors - vol->dataStart) / vol->secPerClust;
+
+  if (clusters < FAT_MAGIC)
+  {
+    vol->fs = FAT12;
+    vol->eoc = 0xFFF;
+  }
+  else if (clusters < FAT_MAGIC16)
+  {
+    vol->fs = FAT16;
+    vol->eoc = 0xFFFF;
+  }
+  else
+  {
+#ifdef WITHFAT32
+    struct bootsectortype32 *bs32 = (struct bootsectortype32 *)bs;
+    vol->fs = FAT32;
+    vol->eoc = 0x0FFFFFFFUL;
+    vol->rootCluster = bs32->bsRootCluster;
+    vol->fsInfoSector = bs32->bsFSInfoSector;
+    vol->backupBoot = bs32->bsBackupBoot;
+    if (bs32->bsFlags & FAT_NO_MIRRORING)
+    {
+      vol->mirror = FALSE;
+      vol->activeFAT = bs32->bsFlags & 0x0F;
+    }
+#else
+    return FALSE;
+#endif
+  }
+  vol->maxCluster = clusters + 1;
+
+  return TRUE;
+}
+
+
+/* returns byte at offset within active FAT, loading its sector as needed */
+static UBYTE *fatByte(FATVolume *vol, ULONG offset)
+{
+  ULONG sector = offset / SEC_SIZE;
+
+  if (sector != vol->fatSector)
+  {
+    if (!flushFAT(vol) ||
+        cacheReadWrite(vol->drive, 1, vol->fatStart + vol->activeFAT * vol->fatSize + sector,
+                       vol->fatBuf, 0) != 0)
+    {
+      vol->ioError = TRUE;
+      vol->fatSector = (ULONG)-1;
+      memset(vol->fatBuf, 0xFF, SEC_SIZE);  /* looks like used clusters */
+      return &vol->fatBuf[(UWORD)(offset % SEC_SIZE)];
+    }
+    vol->fatSector = sector;
+  }
+  return &vol->fatBuf[(UWORD)(offset % SEC_SIZE)];
+}
+
+/* writes cached FAT sector back to each FAT copy if modified; nothing is
+   written once an I/O error occurred, as buffer may not hold real FAT data */
+BOOL flushFAT(FATVolume *vol)
+{
+  UBYTE i;
+
+  if (vol->fatDirty && (vol->ioError || vol->fatSector == (ULONG)-1))
+    vol->fatDirty = FALSE;
+  if (vol->fatDirty)
+  {
+    for (i = 0; i < vol->fats; i++)
+    {
+      if (!vol->mirror && i != vol->activeFAT)
+        continue;
+      if (cacheReadWrite(vol->drive, 1, vol->fatStart + i * vol->fatSize + vol->fatSector,
+                         vol->fatBuf, 1) != 0)
+        vol->ioError = TRUE;
+    }
+    vol->fatDirty = FALSE;
+  }
+  return !vol->ioError;
+}
+
+ULONG getFATEntry(FATVolume *vol, ULONG cluster)
+{
+  ULONG value;
+
+  switch (vol->fs)
+  {
+    case FAT12:
+    {
+      ULONG offset = cluster + cluster / 2;
+      /* entry may straddle two sectors, so fetch each byte separately */
+      value = *fatByte(vol, offset);
+      value |= (UWORD)*fatByte(vol, offset + 1) << 8;
+      if (cluster & 1)
+        value >>= 4;
+      return value & 0xFFF;
+    }
+    case FAT16:
+    {
+      UBYTE *p = fatByte(vol, cluster * SIZEOF_CLST16);
+      return MK_UWORD(p[1], p[0]);
+    }
+    default:
+    {
+      UBYTE *p = fatByte(vol, cluster * SIZEOF_CLST32);
+      value = MK_ULONG(MK_UWORD(p[3], p[2]), MK_UWORD(p[1], p[0]));
+      return value & 0x0FFFFFFFUL;
+    }
+  }
+}
+
+void setFATEntry(FATVolume *vol, ULONG cluster, ULONG value)
+{
+  UBYTE *p;
+
+  switch (vol->fs)
+  {
+    case FAT12:
+    {
+      ULONG offset = cluster + cluster / 2;
+      value &= 0xFFF;
+      p = fatByte(vol, offset);
+      if (cluster & 1)
+        *p = (*p & 0x0F) | (UBYTE)(value << 4);
+      else
+        *p = (UBYTE)value;
+      if (vol->fatSector != (ULONG)-1)
+        vol->fatDirty = TRUE;  /* 1st byte's sector written before moving on */
+      p = fatByte(vol, offset + 1);
+      if (cluster & 1)
+        *p = (UBYTE)(value >> 4);
+      else
+        *p = (*p & 0xF0) | (UBYTE)(value >> 8);
+      break;
+    }
+    case FAT16:
+      p = fatByte(vol, cluster * SIZEOF_CLST16);
+      p[0] = lobyte(value);
+      p[1] = hibyte(value);
+      break;
+    default:
+      p = fatByte(vol, cluster * SIZEOF_CLST32);
+      p[0] = lobyte(value);
+      p[1] = hibyte(value);
+      p[2] = lobyte(hiword(value));
+      /* top 4 bits are reserved and must be preserved */
+      p[3] = (p[3] & 0xF0) | (hibyte(hiword(value)) & 0x0F);
+      break;
+  }
+  /* a sector that failed to load is only a placeholder, never written */
+  if (vol->fatSector != (ULONG)-1)
+    vol->fatDirty = TRUE;
+}
+
+
+/* returns 1st cluster of a run of at least count free clusters, 0 if none */
+ULONG findFreeRun(FATVolume *vol, ULONG count)
+{
+  FreeScan scan;
+
+  if (!count)
+    return 0;
+  startScan(&scan, count, NULL, 0);
+  if (!scanFAT(vol, &scan) || !scan.found.length)
+    return 0;
+  return scan.found.start;
+}
+
+/* returns 1st free cluster from cluster on, 0 if none */
+ULONG nextFreeCluster(FATVolume *vol, ULONG cluster)
+{
+  for (; isCluster(vol, cluster) && !vol->ioError; cluster++)
+    if (getFATEntry(vol, cluster) == 0)
+      return cluster;
+  return 0;
+}
+
+/* returns number of free clusters, optionally the 1st free one (0 if none) */
+ULONG countFreeClusters(FATVolume *vol, ULONG *firstFree)
+{
+  FreeScan scan;
+
+  startScan(&scan, 0, NULL, 0);
+  scanFAT(vol, &scan);
+  if (firstFree)
+    *firstFree = scan.firstFree;
+  return scan.freeCount;
+}
+
+/* marks every cluster in chain starting at cluster as free */
+void freeChain(FATVolume *vol, ULONG cluster)
+{
+  ULONG next, limit = vol->maxCluster;  /* guard against cyclic chains */
+
+  while (isCluster(vol, cluster) && limit-- && !vol->ioError)
+  {
+    next = getFATEntry(vol, cluster);
+    setFATEntry(vol, cluster, FREE);
+    cluster = next;
+  }
+}
+
+
+/* counts clusters in chain and the contiguous runs (extents) they form */
+void countExtents(FATVolume *vol, ULONG cluster, ULONG *clusters, ULONG *extents)
+{
+  ULONG prev = 0, limit = vol->maxCluster;  /* guard against cyclic chains */
+
+  *clusters = *extents = 0;
+  while (isCluster(vol, cluster) && limit-- && !vol->ioError)
+  {
+    if (cluster != prev + 1)
+      (*extents)++;
+    (*clusters)++;
+    prev = cluster;
+    cluster = getFATEntry(vol, cluster);
+  }
+}
+
+
+#define FSINFO_LEADSIG 0x41615252UL  /* "RRaA" at start of FSInfo sector */
+#define FSINFO_SIG     0x61417272UL  /* "rrAa" at start of struct fsinfo */
+#define FSINFO_OFFSET  0x1e4         /* offset of struct fsinfo in sector */
+
+/* reads FAT32 FSInfo sector into sector, returns pointer to its fsinfo
+   structure or NULL if not FAT32 or signatures invalid */
+struct fsinfo *readFSInfo(FATVolume *vol, UBYTE *sector)
+{
+  struct fsinfo *fi = (struct fsinfo *)(sector + FSINFO_OFFSET);
+
+  if (vol->fs != FAT32 || !vol->fsInfoSector || vol->fsInfoSector == 0xFFFF)
+    return NULL;
+  if (cacheReadWrite(vol->drive, 1, vol->fsInfoSector, sector, 0) != 0)
+  {
+    vol->ioError = TRUE;
+    return NULL;
+  }
+  if (*(ULONG *)sector != FSINFO_LEADSIG || (ULONG)fi->fi_signature != FSINFO_SIG ||
+      sector[SEC_SIZE-2] != 0x55 || sector[SEC_SIZE-1] != 0xAA)
+    return NULL;
+  return fi;
+}
+
+/* sets free cluster count and next free cluster in FSInfo sector and its
+   backup (if the backup boot sectors include a valid copy), FALSE if
+   there is no valid FSInfo sector or it could not be written */
+BOOL writeFSInfo(FATVolume *vol, ULONG freeCount, ULONG nextFree)
+{
+  UBYTE sector[SEC_SIZE];
+  struct fsinfo *fi = readFSInfo(vol, sector);
+  UWORD fsInfoSector = vol->fsInfoSector;
+  BOOL ok;
+
+  if (fi == NULL)
+    return FALSE;
+  fi->fi_nfreeclst = (DWORD)freeCount;
+  fi->fi_cluster = (DWORD)nextFree;
+  ok = cacheReadWrite(vol->drive, 1, fsInfoSector, sector, 1) == 0;
+
+  /* backup is at same offset from backup boot sector as original */
+  if (ok && vol->backupBoot && vol->backupBoot != 0xFFFF)
+  {
+    vol->fsInfoSector = vol->backupBoot + fsInfoSector;
+    if ((fi = readFSInfo(vol, sector)) != NULL)
+    {
+      fi->fi_nfreeclst = (DWORD)freeCount;
+      fi->fi_cluster = (DWORD)nextFree;
+      ok = cacheReadWrite(vol->drive, 1, vol->fsInfoSector, sector, 1) == 0;
+    }
+    vol->fsInfoSector = fsInfoSector;
+  }
+  if (!ok)
+    vol->ioError = TRUE;
+  return ok;
+}
+
+
+/* position at 1st sector of root directory, FALSE if none */
+BOOL firstRootSector(FATVolume *vol, DirPos *pos)
+{
+  if (vol->fs == FAT32)
+  {
+    pos->cluster = vol->rootCluster;
+    if (!isCluster(vol, pos->cluster))
+      return FALSE;
+    pos->sector = clusterSector(vol, pos->cluster);
+    pos->left = vol->secPerClust;
+  }
+  else
+  {
+    pos->cluster = 0;
+    pos->sector = vol->rootSector;
+    pos->left = vol->rootDirSectors;
+  }
+  return pos->left != 0;
+}
+
+/* advance to next sector of directory, following cluster chain as needed */
+BOOL nextDirSector(FATVolume *vol, DirPos *pos)
+{
+  if (--pos->left)
+  {
+    pos->sector++;
+    return TRUE;
+  }
+  if (!pos->cluster)  /* end of fixed root directory */
+    return FALSE;
+  pos->cluster = getFATEntry(vol, pos->cluster);
+  if (!isCluster(vol, pos->cluster))
+    return FALSE;
+  pos->sector = clusterSector(vol, pos->cluster);
+  pos->left = vol->secPerClust;
+  return TRUE;
+}
+
+
+/* advance to next cluster of directory, for reading it a cluster at a
+   time: after firstRootSector() pos describes the whole 1st cluster (or
+   fixed root) and after this each further one, FALSE when no more */
+BOOL nextDirCluster(FATVolume *vol, DirPos *pos)
+{
+  if (!pos->cluster)  /* fixed root directory is read as one block */
+    return FALSE;
+  pos->cluster = getFATEntry(vol, pos->cluster);
+  if (!isCluster(vol, pos->cluster))
+    return FALSE;
+  pos->sector = clusterSector(vol, pos->cluster);
+  pos->left = vol->secPerClust;
+  return TRUE;
+}
+
+
+/* searches root directory for name in 8.3 directory (space padded) form;
+   returns TRUE and fills in entry and found if located; unused is set to
+   1st available entry seen (sector 0 if none) so caller can add the name
+*/
+BOOL findRootEntry(FATVolume *vol, const char *name, struct dirent *entry,
+                   DirSlot *found, DirSlot *unused)
+{
+  UBYTE buffer[SEC_SIZE];
+  struct dirent *dir;
+  DirPos pos;
+  BOOL more;
+
+  found->sector = unused->sector = 0;
+  for (more = firstRootSector(vol, &pos); more; more = nextDirSector(vol, &pos))
+  {
+    if (cacheReadWrite(vol->drive, 1, pos.sector, buffer, 0) != 0)
+    {
+      vol->ioError = TRUE;
+      return FALSE;
+    }
+
+    for (dir = (struct dirent *)buffer; dir < (struct dirent *)(buffer + SEC_SIZE); dir++)
+    {
+      if ((*dir->dir_name == '\0') || (*dir->dir_name == EXT_DELETED))
+      {
+        if (!unused->sector)
+        {
+          unused->sector = pos.sector;
+          unused->offset = (UWORD)((UBYTE *)dir - buffer);
+        }
+        if (*dir->dir_name == '\0')  /* end of directory entries reached */
+          return FALSE;
+        continue;
+      }
+      if ((dir->dir_attrib & D_VOLID) || (dir->dir_attrib & D_DIR))
+        continue;  /* skip volume label, LFN, and subdirectory entries */
+      if (memcmp(dir->dir_name, name, FNAME_SIZE + FEXT_SIZE) == 0)
+      {
+        found->sector = pos.sector;
+        found->offset = (UWORD)((UBYTE *)dir - buffer);
+        memcpy(entry, dir, DIRENT_SIZE);
+        return TRUE;
+      }
+    }
+  }
+  return FALSE;
+}
+
+/* updates directory entry at slot */
+BOOL writeDirEntry(FATVolume *vol, DirSlot *slot, struct dirent *entry)
+{
+  UBYTE buffer[SEC_SIZE];
+
+  if (cacheReadWrite(vol->drive, 1, slot->sector, buffer, 0) != 0)
+    return FALSE;
+  memcpy(buffer + slot->offset, entry, DIRENT_SIZE);
+  return cacheReadWrite(vol->drive, 1, slot->sector, buffer, 1) == 0;
+}
+
+
+/* copies ASCIIZ filename to directory 8.3 format padded with spaces */
+void setFilename(char *buffer, char const *filename)
+{
+  int i;
+  /* pad with spaces, if name.ext is less than 8.3 blanks filled with spaces */
+  memset(buffer, ' ', 11);
+  /* copy over up to 8 characters of filename and 3 characters of extension */
+  for (i = 0; *filename && (*filename != '.'); i++, filename++)
+    if (i<FNAME_SIZE) buffer[i] = toupper(*filename);
+  if (*filename == '.')
+  {
+    filename++; /* skip past . */
+    for (i = 8; (i < 11) && *filename; i++, filename++)
+      buffer[i] = toupper(*filename);
+  }
+}
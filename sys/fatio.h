@@ -0,0 +1,203 @@
+/***************************************************************
+
+                                    fatio.h
+                                    DOS-C
+
+                            sys utility for DOS-C
+
+                             Copyright (c) 1991
+                             Pasquale J. Villani
+                             All Rights Reserved
+
+ This file is part of DOS-C.
+
+ DOS-C is free software; you can redistribute it and/or modify it under the
+ terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ DOS-C is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ details.
+
+ You should have received a copy of the GNU General Public License along with
+ DOS-C; see the file COPYING.  If not, write to the Free Software Foundation,
+ 675 Mass Ave, Cambridge, MA 02139, USA.
+
+***************************************************************/
+
+/* assumes sys.h and diskio.h already included */
+
+#ifndef _FATIO_H_
+#define _FATIO_H_
+
+struct bootsectortype {
+  UBYTE bsJump[3];
+  char OemName[8];
+  UWORD bsBytesPerSec;
+  UBYTE bsSecPerClust;
+  UWORD bsResSectors;
+  UBYTE bsFATs;
+  UWORD bsRootDirEnts;
+  UWORD bsSectors;
+  UBYTE bsMedia;
+  UWORD bsFATsecs;
+  UWORD bsSecPerTrack;
+  UWORD bsHeads;
+  ULONG bsHiddenSecs;
+  ULONG bsHugeSectors;
+  UBYTE bsDriveNumber;
+  UBYTE bsReserved1;
+  UBYTE bsBootSignature;
+  ULONG bsVolumeID;
+  char bsVolumeLabel[11];
+  char bsFileSysType[8];
+};
+
+struct bootsectortype32 {
+  UBYTE bsJump[3];
+  char OemName[8];
+  UWORD bsBytesPerSec;
+  UBYTE bsSecPerClust;
+  UWORD bsResSectors;
+  UBYTE bsFATs;
+  UWORD bsRootDirEnts;
+  UWORD bsSectors;
+  UBYTE bsMedia;
+  UWORD bsFATsecs;
+  UWORD bsSecPerTrack;
+  UWORD bsHeads;
+  ULONG bsHiddenSecs;
+  ULONG bsHugeSectors;
+  ULONG bsBigFatSize;
+  UBYTE bsFlags;
+  UBYTE bsMajorVersion;
+  UWORD bsMinorVersion;
+  ULONG bsRootCluster;
+  UWORD bsFSInfoSector;
+  UWORD bsBackupBoot;
+  ULONG bsReserved2[3];
+  UBYTE bsDriveNumber;
+  UBYTE bsReserved3;
+  UBYTE bsExtendedSignature;
+  ULONG bsSerialNumber;
+  char bsVolumeLabel[11];
+  char bsFileSystemID[8];
+};
+
+
+/* layout of a FAT volume, as determined from its BPB, along with a
+   single sector cache of its (active) FAT; used for raw access to
+   the FAT and root directory bypassing DOS
+*/
+typedef struct FATVolume {
+  unsigned drive;               /* DOS drive, 0=A: */
+  FileSystem fs;                /* FAT12, FAT16, or FAT32 */
+  UWORD secPerClust;            /* sectors per cluster */
+  UBYTE fats;                   /* number of FAT copies */
+  UBYTE activeFAT;              /* FAT read from, only one written if !mirror */
+  BOOL mirror;                  /* update all FAT copies */
+  ULONG fatStart;               /* 1st sector of 1st FAT */
+  ULONG fatSize;                /* sectors per FAT */
+  ULONG rootSector;             /* 1st sector of fixed root (FAT12/16) */
+  UWORD rootDirSectors;         /* sectors in fixed root (FAT12/16) */
+  ULONG rootCluster;            /* 1st cluster of root (FAT32) */
+  UWORD fsInfoSector;           /* FSInfo sector (FAT32) */
+  UWORD backupBoot;             /* backup boot sector (FAT32) */
+  ULONG dataStart;              /* 1st sector of cluster 2 */
+  ULONG maxCluster;             /* highest valid cluster number */
+  ULONG eoc;                    /* end of chain value for this fs */
+  BOOL ioError;                 /* set if any sector read/write failed */
+
+  ULONG fatSector;              /* FAT relative sector cached, -1 if none */
+  BOOL fatDirty;                /* cached FAT sector needs writing */
+  UBYTE fatBuf[SEC_SIZE];
+} FATVolume;
+
+/* location of a directory entry on disk */
+typedef struct {
+  ULONG sector;                 /* sector holding entry, 0 if none */
+  UWORD offset;                 /* byte offset of entry within sector */
+} DirSlot;
+
+/* position while walking a directory a sector at a time */
+typedef struct {
+  ULONG cluster;                /* current cluster, 0 for fixed root */
+  ULONG sector;                 /* current sector */
+  UWORD left;                   /* sectors left in cluster or fixed root */
+} DirPos;
+
+/* read BPB of drive and determine layout, FALSE if not a usable FAT volume */
+BOOL openVolume(FATVolume *vol, unsigned drive);
+
+/* FAT access, reads and writes go through a one sector cache */
+ULONG getFATEntry(FATVolume *vol, ULONG cluster);
+void setFATEntry(FATVolume *vol, ULONG cluster, ULONG value);
+BOOL flushFAT(FATVolume *vol);
+#define isEOC(vol, value) ((value) >= ((vol)->eoc & ~7UL))
+#define isCluster(vol, value) ((value) >= 2 && (value) <= (vol)->maxCluster)
+#define clusterSector(vol, cluster) \
+  ((vol)->dataStart + ((cluster) - 2) * (vol)->secPerClust)
+
+/* free space found by scanning FAT (fatscan.c): startScan(), then either
+   scanFAT() for a volume or scanFATBlock() for each block of FAT data
+   then finishScan(); with wanted set scanFAT() stops once run found */
+typedef struct {
+  ULONG start;                  /* 1st cluster */
+  ULONG length;                 /* clusters */
+} FreeExtent;
+
+typedef struct {
+  ULONG wanted;                 /* run length looked for, 0 if none */
+  FreeExtent *extents;          /* optional list of free runs found */
+  unsigned maxExtents;          /* size of list */
+  ULONG freeCount;              /* free clusters */
+  ULONG firstFree;              /* 1st free cluster, 0 if none */
+  FreeExtent longest;           /* longest run of free clusters */
+  FreeExtent found;             /* 1st run at least wanted long, length 0 if none */
+  ULONG extentCount;            /* runs found, may be more than maxExtents */
+  FreeExtent run;               /* run being scanned */
+} FreeScan;
+
+void startScan(FreeScan *scan, ULONG wanted, FreeExtent *extents, unsigned maxExtents);
+void scanFATBlock(FileSystem fs, const UBYTE FAR *fat, ULONG cluster, ULONG count, FreeScan *scan);
+void finishScan(FreeScan *scan);
+BOOL scanFAT(FATVolume *vol, FreeScan *scan);
+enum {SCAN_FAST, SCAN_SCALAR};
+extern int fatScanMode;         /* normally SCAN_FAST, varied by benchmark */
+
+/* returns 1st cluster of a run of at least count free clusters, 0 if none */
+ULONG findFreeRun(FATVolume *vol, ULONG count);
+/* returns 1st free cluster from cluster on, 0 if none */
+ULONG nextFreeCluster(FATVolume *vol, ULONG cluster);
+/* returns number of free clusters, optionally the 1st free one (0 if none) */
+ULONG countFreeClusters(FATVolume *vol, ULONG *firstFree);
+/* marks every cluster in chain starting at cluster as free */
+void freeChain(FATVolume *vol, ULONG cluster);
+/* counts clusters in chain and the contiguous runs (extents) they form */
+void countExtents(FATVolume *vol, ULONG cluster, ULONG *clusters, ULONG *extents);
+#define startCluster(vol, entry) ((vol)->fs == FAT32 ? \
+  MK_ULONG((entry)->dir_start_high, (entry)->dir_start) : (ULONG)(entry)->dir_start)
+
+/* reads FAT32 FSInfo sector into sector, returns pointer to its fsinfo
+   structure or NULL if not FAT32 or signatures invalid */
+#define FSINFO_UNKNOWN 0xFFFFFFFFUL  /* free count or next free not known */
+struct fsinfo *readFSInfo(FATVolume *vol, UBYTE *sector);
+/* updates FSInfo sector (and its backup), FSINFO_UNKNOWN if not known */
+BOOL writeFSInfo(FATVolume *vol, ULONG freeCount, ULONG nextFree);
+
+/* walk root directory a sector at a time, FALSE when no more sectors */
+BOOL firstRootSector(FATVolume *vol, DirPos *pos);
+BOOL nextDirSector(FATVolume *vol, DirPos *pos);
+/* or a cluster (pos->left sectors from pos->sector) at a time */
+BOOL nextDirCluster(FATVolume *vol, DirPos *pos);
+
+/* searches root directory for name in 8.3 directory (space padded) form */
+BOOL findRootEntry(FATVolume *vol, const char *name, struct dirent *entry,
+                   DirSlot *found, DirSlot *unused);
+BOOL writeDirEntry(FATVolume *vol, DirSlot *slot, struct dirent *entry);
+
+/* copies ASCIIZ filename to directory 8.3 format padded with spaces */
+void setFilename(char *buffer, char const *filename);
+
+#endif /* _FATIO_H_ */
@@ -0,0 +1,322 @@
+/***************************************************************
+
+                                   fatscan.c
+                                    DOS-C
+
+                            sys utility for DOS-C
+
+                             Copyright (c) 1991
+                             Pasquale J. Villani
+                             All Rights Reserved
+
+ This file is part of DOS-C.
+
+ DOS-C is free software; you can redistribute it and/or modify it under the
+ terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ DOS-C is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ details.
+
+ You should have received a copy of the GNU General Public License along with
+ DOS-C; see the file COPYING.  If not, write to the Free Software Foundation,
+ 675 Mass Ave, Cambridge, MA 02139, USA.
+
+***************************************************************/
+
+/* FAT scanning: counts free clusters and finds the first free cluster,
+   the longest run of free clusters, the first run of at least a wanted
+   length, and a list of free runs (extents).  The FAT is read in large
+   blocks rather than a sector at a time through FATVolume's cache, and
+   each block is scanned by a kernel for its FAT type.  On the host the
+   kernels step over 16 bytes of entries at once (using SSE2 where the
+   compiler provides it, else pairs of 64 bit words) while these are all
+   free or all in use, looking at single entries only where the two
+   meet.  Elsewhere (the DOS build) they are simple per entry loops.
+*/
+
+#include "sys.h"
+#include "diskio.h"
+#include "fatio.h"
+
+#if (defined __unix__ || defined _WIN32) && defined __GNUC__ && \
+    defined __BYTE_ORDER__ && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define WIDE_SCAN               /* step over 16 bytes of entries at once */
+#ifdef __SSE2__
+#include <emmintrin.h>
+#else
+#include <stdint.h>
+#endif
+#endif
+
+#define SCAN_SECTORS 120        /* FAT sectors read at once, multiple of 3 */
+
+int fatScanMode = SCAN_FAST;
+
+enum {MIXED, ALL_FREE, ALL_USED};
+
+
+void startScan(FreeScan *scan, ULONG wanted, FreeExtent *extents, unsigned maxExtents)
+{
+  memset(scan, 0, sizeof(FreeScan));
+  scan->wanted = wanted;
+  scan->extents = extents;
+  scan->maxExtents = maxExtents;
+}
+
+/* n free clusters from cluster on */
+static void addFree(FreeScan *scan, ULONG cluster, ULONG n)
+{
+  if (!scan->run.length)
+    scan->run.start = cluster;
+  scan->run.length += n;
+  scan->freeCount += n;
+}
+
+/* cluster in use, ends any run of free ones */
+static void endRun(FreeScan *scan)
+{
+  FreeExtent *run = &scan->run;
+
+  if (!run->length)
+    return;
+  if (!scan->firstFree)
+    scan->firstFree = run->start;
+  if (scan->extentCount < scan->maxExtents)
+    scan->extents[(unsigned)scan->extentCount] = *run;
+  scan->extentCount++;
+  if (run->length > scan->longest.length)
+    scan->longest = *run;
+  if (scan->wanted && !scan->found.length && run->length >= scan->wanted)
+    scan->found = *run;
+  run->length = 0;
+}
+
+void finishScan(FreeScan *scan)
+{
+  endRun(scan);
+}
+
+#define scanEntry(scan, cluster, value) \
+  do { if ((value) == FREE) addFree(scan, cluster, 1); else endRun(scan); } while (0)
+#define entry12even(p) ((p)[0] | ((UWORD)((p)[1] & 0x0F) << 8))
+#define entry12odd(p) (((p)[1] >> 4) | ((UWORD)(p)[2] << 4))
+#define entry32(p) \
+  (MK_ULONG(MK_UWORD((p)[3], (p)[2]), MK_UWORD((p)[1], (p)[0])) & LONG_LAST_CLUSTER)
+
+
+#ifdef WIDE_SCAN
+/* classifies 16 bytes of FAT entries (of bits size, FAT32 ones masked) */
+#ifdef __SSE2__
+static int classify(const UBYTE *p, int bits)
+{
+  __m128i v = _mm_loadu_si128((const __m128i *)p), zero = _mm_setzero_si128();
+  int mask;
+
+  if (bits == 32)
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi32(
+             _mm_and_si128(v, _mm_set1_epi32(LONG_LAST_CLUSTER)), zero));
+  else if (bits == 16)
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi16(v, zero));
+  else  /* FAT12 entries straddle bytes, only all free is found */
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) == 0xFFFF ? ALL_FREE : MIXED;
+  return (mask == 0xFFFF) ? ALL_FREE : (mask == 0) ? ALL_USED : MIXED;
+}
+#else
+static int classify(const UBYTE *p, int bits)
+{
+  uint64_t a, b, ones, highs;
+
+  memcpy(&a, p, 8);
+  memcpy(&b, p + 8, 8);
+  if (bits == 32)
+  {
+    a &= 0x0FFFFFFF0FFFFFFFULL;
+    b &= 0x0FFFFFFF0FFFFFFFULL;
+    ones = 0x0000000100000001ULL;
+    highs = 0x8000000080000000ULL;
+  }
+  else if (bits == 16)
+  {
+    ones = 0x0001000100010001ULL;
+    highs = 0x8000800080008000ULL;
+  }
+  else
+    return (a | b) == 0 ? ALL_FREE : MIXED;
+  if ((a | b) == 0)
+    return ALL_FREE;
+  /* no entry is zero if no lane has its borrow and high bit clear */
+  if ((((a - ones) & ~a) | ((b - ones) & ~b)) & highs)
+    return MIXED;
+  return ALL_USED;
+}
+#endif
+#endif /* WIDE_SCAN */
+
+/* FAT12 packs pairs of entries into 3 bytes, 16 entries into 24 */
+static void scan12(const UBYTE FAR *p, ULONG cluster, ULONG count, FreeScan *scan)
+{
+  ULONG i = 0;
+  unsigned j;
+
+  for (; i + 16 <= count; i += 16, p += 24)
+  {
+#ifdef WIDE_SCAN
+    if (fatScanMode == SCAN_FAST && classify(p, 12) == ALL_FREE &&
+        classify(p + 8, 12) == ALL_FREE)
+    {
+      addFree(scan, cluster + i, 16);
+      continue;
+    }
+#endif
+    for (j = 0; j < 16; j += 2)
+    {
+      scanEntry(scan, cluster + i + j, entry12even(p + j / 2 * 3));
+      scanEntry(scan, cluster + i + j + 1, entry12odd(p + j / 2 * 3));
+    }
+  }
+  for (; i < count; i += 2, p += 3)
+  {
+    scanEntry(scan, cluster + i, entry12even(p));
+    if (i + 1 < count)
+      scanEntry(scan, cluster + i + 1, entry12odd(p));
+  }
+}
+
+static void scan16(const UBYTE FAR *p, ULONG cluster, ULONG count, FreeScan *scan)
+{
+  ULONG i = 0;
+  unsigned j;
+
+#ifdef WIDE_SCAN
+  if (fatScanMode == SCAN_FAST)
+  {
+    for (; i + 8 <= count; i += 8, p += 16)
+    {
+      switch (classify(p, 16))
+      {
+        case ALL_FREE:
+          addFree(scan, cluster + i, 8);
+          break;
+        case ALL_USED:
+          endRun(scan);
+          break;
+        default:
+          for (j = 0; j < 8; j++)
+            scanEntry(scan, cluster + i + j, MK_UWORD(p[j * 2 + 1], p[j * 2]));
+      }
+    }
+  }
+#endif
+  for (; i < count; i++, p += SIZEOF_CLST16)
+    scanEntry(scan, cluster + i, MK_UWORD(p[1], p[0]));
+}
+
+static void scan32(const UBYTE FAR *p, ULONG cluster, ULONG count, FreeScan *scan)
+{
+  ULONG i = 0;
+  unsigned j;
+
+#ifdef WIDE_SCAN
+  if (fatScanMode == SCAN_FAST)
+  {
+    for (; i + 4 <= count; i += 4, p += 16)
+    {
+      switch (classify(p, 32))
+      {
+        case ALL_FREE:
+          addFree(scan, cluster + i, 4);
+          break;
+        case ALL_USED:
+          endRun(scan);
+          break;
+        default:
+          for (j = 0; j < 4; j++)
+            scanEntry(scan, cluster + i + j, entry32(p + j * 4));
+      }
+    }
+  }
+#endif
+  for (; i < count; i++, p += SIZEOF_CLST32)
+    scanEntry(scan, cluster + i, entry32(p));
+}
+
+/* scans count entries of FAT data fat, the 1st for cluster (which must be
+   even for FAT12), continuing any free run from the previous block */
+void scanFATBlock(FileSystem fs, const UBYTE FAR *fat, ULONG cluster, ULONG count, FreeScan *scan)
+{
+  if (fs == FAT12)
+    scan12(fat, cluster, count, scan);
+  else if (fs == FAT16)
+    scan16(fat, cluster, count, scan);
+  else
+    scan32(fat, cluster, count, scan);
+}
+
+/* byte offset of entry n of FAT */
+static ULONG entryOffset(FileSystem fs, ULONG n)
+{
+  return (fs == FAT12) ? n + n / 2 : (fs == FAT16) ? n * SIZEOF_CLST16 : n * SIZEOF_CLST32;
+}
+
+/* entries held in sectors of FAT (FAT12: whole pairs, sectors a multiple of 3) */
+static ULONG entriesIn(FileSystem fs, unsigned sectors)
+{
+  ULONG bytes = (ULONG)sectors * SEC_SIZE;
+
+  return (fs == FAT12) ? bytes / 3 * 2 : (fs == FAT16) ? bytes / SIZEOF_CLST16 : bytes / SIZEOF_CLST32;
+}
+
+#define scanDone(scan) ((scan)->wanted && \
+  ((scan)->found.length || (scan)->run.length >= (scan)->wanted))
+
+/* scans active FAT of vol for clusters 2 on, results in scan (set up by
+   startScan()); if a wanted run length was given, stops once one found
+   so other results only cover the FAT up to it; FALSE on a read error */
+BOOL scanFAT(FATVolume *vol, FreeScan *scan)
+{
+  ULONG fatSector = vol->fatStart + vol->activeFAT * vol->fatSize;
+  ULONG block, cluster = 2, first, count;
+  unsigned sectors;
+  BYTE FAR *buffer;
+
+  /* FAT on disk must include any change still in FATVolume's cache */
+  if (!flushFAT(vol))
+    return FALSE;
+
+  if ((buffer = allocBlock((ULONG)SCAN_SECTORS * SEC_SIZE)) == NULL)
+  {
+    /* low on memory, an entry at a time through the FAT sector cache */
+    for (; cluster <= vol->maxCluster && !vol->ioError && !scanDone(scan); cluster++)
+      scanEntry(scan, cluster, getFATEntry(vol, cluster));
+    finishScan(scan);
+    return !vol->ioError;
+  }
+
+  for (block = 0; cluster <= vol->maxCluster && !scanDone(scan); block++)
+  {
+    first = block * entriesIn(vol->fs, SCAN_SECTORS);
+    if (block * SCAN_SECTORS >= vol->fatSize)
+      break;  /* FAT too small for clusters, rest can't be free */
+    sectors = SCAN_SECTORS;
+    if (block * SCAN_SECTORS + sectors > vol->fatSize)
+      sectors = (unsigned)(vol->fatSize - block * SCAN_SECTORS);
+    if (cacheReadWrite(vol->drive, sectors, fatSector + block * SCAN_SECTORS, buffer, 0) != 0)
+    {
+      vol->ioError = TRUE;
+      break;
+    }
+    count = first + entriesIn(vol->fs, sectors);
+    if (count > vol->maxCluster + 1)
+      count = vol->maxCluster + 1;
+    count -= cluster;
+    scanFATBlock(vol->fs, (UBYTE FAR *)hugeAdd(buffer, entryOffset(vol->fs, cluster - first)),
+                 cluster, count, scan);
+    cluster += count;
+  }
+  freeBlock(buffer);
+  finishScan(scan);
+  return !vol->ioError;
+}
@@ -26,7 +26,7 @@ char KERNEL[] = "KERNEL.SYS";
  * #including <stdio.h> to make executable MUCH smaller
  * using [s]printf from prf.c!
  */
-#ifdef _WIN32
+#if defined _WIN32 || defined __unix__
 #include <stdio.h>
 #else
 extern int VA_CDECL printf(CONST char FAR * fmt, ...);
@@ -48,12 +48,20 @@ unsigned long lseek(int fildes, unsigned long offset, int whence);
       parm [bx] [dx cx] [ax] \
       value [dx ax];
 
+#elif defined __unix__
+#include <unistd.h>
+#include <strings.h>
+#include <sys/stat.h>
+#define O_BINARY 0
+#define memicmp strncasecmp
 #else
 #include <io.h>
 /* #include <stdio.h> */
 #endif
 
+#ifndef FAR
 #define FAR far
+#endif
 #include "kconfig.h"
 
 KernelConfig cfg; /* static memory zeroed automatically */
@@ -115,7 +123,7 @@ int readConfigSettings(int kfile, char *kfilename, KernelConfig * cfg)
     printf("can't seek to offset 2\n"), exit(1);
 
   if (read(kfile, cfg, sizeof(KernelConfig)) != sizeof(KernelConfig))
-    printf("can't read %u bytes\n", sizeof(KernelConfig)), exit(1);
+    printf("can't read %u bytes\n", (unsigned)sizeof(KernelConfig)), exit(1);
 
   if (memcmp(cfg->CONFIG, "CONFIG", 6) != 0)
   {
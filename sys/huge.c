@@ -0,0 +1,196 @@
+/***************************************************************
+
+                                    huge.c
+                                    DOS-C
+
+                            sys utility for DOS-C
+
+                             Copyright (c) 1991
+                             Pasquale J. Villani
+                             All Rights Reserved
+
+ This file is part of DOS-C.
+
+ DOS-C is free software; you can redistribute it and/or modify it under the
+ terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ DOS-C is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ details.
+
+ You should have received a copy of the GNU General Public License along with
+ DOS-C; see the file COPYING.  If not, write to the Free Software Foundation,
+ 675 Mass Ave, Cambridge, MA 02139, USA.
+
+***************************************************************/
+
+/* huge buffers: blocks of memory outside our own segment that may exceed
+   64KB, along with bulk transfers between them and files or memory.
+   Transfers are done in runs that never cross a segment boundary, so a
+   run is at most HUGE_CHUNK bytes and needs no per byte pointer fixups.
+*/
+
+#include "sys.h"
+#include "diskio.h"
+
+#ifdef __TURBOC__
+#include <mem.h>
+#endif
+
+
+#if defined _WIN32 || defined __unix__
+
+BYTE FAR *allocBlock(ULONG memsize)
+{
+#ifdef __unix__
+  void *ptr;
+
+  /* aligned so it may be used for direct I/O */
+  return posix_memalign(&ptr, DIRECT_ALIGN, (size_t)memsize) ? NULL : (BYTE *)ptr;
+#else
+  return (BYTE *)malloc((size_t)memsize);
+#endif
+}
+
+void freeBlock(BYTE FAR *ptr)
+{
+  free(ptr);
+}
+
+/* no real limit, pick a generous default */
+ULONG availBlock(void)
+{
+  return 0x100000UL;
+}
+
+#define readWrite(fd, buf, count, wr) \
+  (unsigned)((wr) ? write(fd, buf, count) : read(fd, buf, count))
+#define moveRun(dst, src, count) memmove(dst, src, count)
+
+#else
+
+/* allocate memory from DOS, return NULL on error, pointer to buffer otherwise */
+BYTE FAR *allocBlock(ULONG memsize)
+{
+  unsigned dseg;
+#ifdef __TURBOC__
+  if (allocmem((unsigned)((memsize+15)>>4), &dseg)!=-1)
+#else
+  if (_dos_allocmem((unsigned)((memsize+15)>>4), &dseg)!=0)
+#endif
+    return NULL; /* failed to allocate memory */
+
+  return MK_FP(dseg, 0); /* success */
+}
+
+void freeBlock(BYTE FAR *ptr)
+{
+#ifdef __TURBOC__
+  freemem(FP_SEG(ptr));
+#else
+  _dos_freemem(FP_SEG(ptr));
+#endif
+}
+
+/* returns size in bytes of largest block allocBlock() could currently provide */
+ULONG availBlock(void)
+{
+  unsigned dseg = 0;
+#ifdef __TURBOC__
+  /* on failure returns size of largest available block */
+  dseg = allocmem(0xFFFF, &dseg);
+#else
+  /* on failure stores size of largest available block in dseg */
+  _dos_allocmem(0xFFFF, &dseg);
+#endif
+  return (ULONG)dseg << 4;
+}
+
+/* returns ptr advanced by bytes, normalized so offset is 0..15 */
+BYTE FAR *hugeAdd(BYTE FAR *ptr, ULONG bytes)
+{
+  bytes += FP_OFF(ptr);
+  return MK_FP(FP_SEG(ptr) + (unsigned)(bytes >> 4), (unsigned)bytes & 0xF);
+}
+
+/* reads or writes count bytes between file and far buffer,
+   returns bytes transferred or (unsigned)-1 on error */
+#if defined __WATCOMC__ || defined _MSC_VER
+static unsigned readWrite(int fd, BYTE FAR *buf, unsigned count, int write)
+{
+  unsigned bytes;
+  if ((write ? _dos_write(fd, buf, count, &bytes)
+             : _dos_read(fd, buf, count, &bytes)) != 0)
+    return (unsigned)-1;
+  return bytes;
+}
+#else
+static unsigned readWrite(int fd, BYTE FAR *buf, unsigned count, int write)
+{
+  union REGS regs;
+  struct SREGS sregs;
+
+  regs.h.ah = write ? 0x40 : 0x3f;  /* DOS write/read file or device */
+  regs.x.bx = fd;
+  regs.x.cx = count;
+  sregs.ds = FP_SEG(buf);
+  regs.x.dx = FP_OFF(buf);
+  intdosx(&regs, &regs, &sregs);
+  return regs.x.cflag ? (unsigned)-1 : regs.x.ax;
+} /* readWrite */
+#endif
+
+/* both pointers are normalized so a run can not wrap the segment */
+#define moveRun(dst, src, count) \
+  movedata(FP_SEG(src), FP_OFF(src), FP_SEG(dst), FP_OFF(dst), count)
+
+#endif /* _WIN32 || __unix__ */
+
+
+/* transfers len bytes between file and huge buffer a run at a time,
+   returns bytes transferred (less on end of file) or (ULONG)-1 on error */
+static ULONG hugeReadWrite(int fd, BYTE FAR *buf, ULONG len, int writing)
+{
+  ULONG done = 0;
+
+  while (done < len)
+  {
+    unsigned run = (len - done > HUGE_CHUNK) ? HUGE_CHUNK : (unsigned)(len - done);
+    unsigned got = readWrite(fd, hugeAdd(buf, done), run, writing);
+
+    if (got == (unsigned)-1)
+      return (ULONG)-1;
+    done += got;
+    if (got < run)  /* end of file or disk full */
+      break;
+  }
+  return done;
+}
+
+ULONG hugeRead(int fd, BYTE FAR *buf, ULONG len)
+{
+  return hugeReadWrite(fd, buf, len, 0);
+}
+
+ULONG hugeWrite(int fd, BYTE FAR *buf, ULONG len)
+{
+  return hugeReadWrite(fd, buf, len, 1);
+}
+
+/* copies len bytes between huge buffers, one run per segment crossed */
+void hugeMove(BYTE FAR *dst, BYTE FAR *src, ULONG len)
+{
+  ULONG done = 0;
+
+  while (done < len)
+  {
+    unsigned run = (len - done > HUGE_CHUNK) ? HUGE_CHUNK : (unsigned)(len - done);
+    BYTE FAR *d = hugeAdd(dst, done);
+    BYTE FAR *s = hugeAdd(src, done);
+
+    moveRun(d, s, run);
+    done += run;
+  }
+}
@@ -136,6 +136,8 @@ CONST char * msgDOS[DOSFLAVORS] = {  /* order should match above items */
 
 #ifdef _WIN32
 #define getcurdrive -1+(unsigned)_getdrive
+#elif defined __unix__
+#include "diskio.h"
 #else
 #ifndef __WATCOMC__
 /* returns current DOS drive, A=0, B=1,C=2, ... */
@@ -162,13 +164,37 @@ unsigned getcurdrive(void);
 #endif
 
 
+/* select destination drive and apply its defaults (boot drive #, etc.) */
+void setDestination(SYSOptions *opts, BYTE drive)
+{
+  opts->dstDrive = drive;
+  opts->ignoreBIOS = opts->userIgnoreBIOS;
+  opts->defBootDrive = opts->userBootDrive;
+
+  /* did user insist on always using BIOS provided drive # */
+  if (opts->ignoreBIOS == -1)
+    opts->ignoreBIOS = 0;  /* its really a boolean value in rest of code */
+  /* if destination is floppy (A: or B:) then use drive # stored in boot sector */
+  else if (drive < 2)
+    opts->ignoreBIOS = 1;
+
+  /* if bios drive to store in boot sector not set and not floppy set to 1st hd */
+  if (!opts->defBootDrive && (drive >= 2))
+    opts->defBootDrive = 0x80;
+  /* else opts->defBootDrive = 0x0; the 1st floppy */
+}
+
+
 /* get and validate arguments */
 void initOptions(int argc, char *argv[], SYSOptions *opts)
 {
   int argno;
   int drivearg = 0;           /* drive argument, position of 1st or 2nd non option */
   int srcarg = 0;             /* nonzero if optional source argument */
-  BYTE srcFile[SYS_MAXPATH];  /* full path+name of [kernel] file [to copy] */
+  char *drives = NULL;        /* additional destination drives */
+  /* full path+name of [kernel] file [to copy], room for source path
+     plus a file name given on the command line */
+  BYTE srcFile[2 * SYS_MAXPATH];
   struct stat fstatbuf;
   void (*otherAction)(SYSOptions *opts) = NULL;
 
@@ -184,7 +210,12 @@ void initOptions(int argc, char *argv[], SYSOptions *opts)
   {
     char *argp = argv[argno];
 
+#ifdef __unix__
+    /* absolute host paths start with / too, one that exists is not a switch */
+    if (argp[0] == '/' && timedStat(argp, &fstatbuf) != 0)
+#else
     if (argp[0] == '/')  /* optional switch */
+#endif
     {
       argp++;  /* skip past the '/' character */
 
@@ -361,6 +392,51 @@ void initOptions(int argc, char *argv[], SYSOptions *opts)
           showHelpAndExit();
         }
       }
+      /* skip copying files and boot sector already up to date */
+      else if (memicmp(argp, "INCR", 4) == 0)
+      {
+        argp += 4;
+        if (!*argp)
+          opts->incremental = SAMETIME;
+        else if (memicmp(argp, ":CRC", 4) == 0)
+          opts->incremental = SAMECRC;
+        else
+        {
+          printf("%s: invalid INCR qualifier %s\n", pgm, argp);
+          showHelpAndExit();
+        }
+      }
+      /* read back copied files and compare checksums */
+      else if (memicmp(argp, "VERIFY", 6) == 0)
+      {
+        opts->verify = 1;
+      }
+#ifdef __unix__
+      /* bypass host's page cache for images and devices */
+      else if (memicmp(argp, "DIRECT", 6) == 0)
+      {
+        setDirectIO(TRUE);
+      }
+#endif
+#ifdef WITHSTATS
+      /* print disk and file I/O totals when done */
+      else if (memicmp(argp, "STATS", 5) == 0)
+      {
+        opts->stats = 1;
+      }
+#endif
+#ifdef WITHCONTIG
+      /* write kernel files to a single run of clusters */
+      else if (memicmp(argp, "CONTIG", 6) == 0)
+      {
+        opts->contig = 1;
+      }
+      /* move fragmented system files already on drive to single runs */
+      else if (memicmp(argp, "DEFRAG", 6) == 0)
+      {
+        opts->defrag = 1;
+      }
+#endif
       /* skips copying boot sector to backup bs, FAT32 only else ignored */
       else if (memicmp(argp, "NOBAKBS", 7) == 0)
       {
@@ -381,6 +457,35 @@ void initOptions(int argc, char *argv[], SYSOptions *opts)
         {
           opts->defBootDrive = (BYTE)strtol(argv[argno], NULL, 16);
         }
+        else if (memicmp(argp, "DRIVES", 6) == 0) /* also install to these drives */
+        {
+          drives = argv[argno];
+        }
+#ifdef __unix__
+        else if (memicmp(argp, "GEOMETRY", 8) == 0) /* heads,sectors of image */
+        {
+          char *sectors;
+          long heads = strtol(argv[argno], &sectors, 10);
+
+          if (*sectors != ',' || heads < 1 || heads > 255 ||
+              atoi(sectors + 1) < 1 || atoi(sectors + 1) > 63)
+          {
+            printf("%s: invalid geometry %s, expected heads,sectors\n", pgm, argv[argno]);
+            showHelpAndExit();
+          }
+          setGeometry((unsigned)heads, (unsigned)atoi(sectors + 1));
+        }
+#endif
+        else if (memicmp(argp, "MANIFEST", 8) == 0) /* additional files to copy */
+        {
+          opts->manifest = argv[argno];
+        }
+#ifdef WITHSTATS
+        else if (memicmp(argp, "TRACE", 5) == 0) /* log each I/O operation */
+        {
+          opts->traceFile = argv[argno];
+        }
+#endif
         /* options not documented by showHelpAndExit() */
         else if (memicmp(argp, "SKFN", 4) == 0) /* set KERNEL.SYS input file and /OEM:FD */
         {
@@ -435,6 +540,20 @@ void initOptions(int argc, char *argv[], SYSOptions *opts)
     {
       drivearg = argno;         /* either source or destination drive */
     }
+#ifdef __unix__
+    else if (!srcarg /* && drivearg */ && !opts->bsFile)
+    {
+      /* host build: source is a directory, destination an image or device,
+         so 1st arg directory is [source] dest form else dest [bootfile] */
+      if (timedStat(argv[drivearg], &fstatbuf) == 0 && S_ISDIR(fstatbuf.st_mode))
+      {
+        srcarg = drivearg;
+        drivearg = argno;
+      }
+      else
+        opts->bsFile = argv[argno];
+    }
+#else
     else if (!srcarg /* && drivearg */ && !opts->bsFile)
     {
       /* need to determine is user specified [source] dest or dest [bootfile] (or [source] dest [bootfile])
@@ -469,22 +588,44 @@ void initOptions(int argc, char *argv[], SYSOptions *opts)
         }
       }
     }
+#endif
     else if (!opts->bsFile /* && srcarg && drivearg */)
     {
       opts->bsFile = argv[argno];
     }
     else /* if (opts->bsFile && srcarg && drivearg) */
     {
+#ifndef __unix__
       EXITBADARG:
+#endif
       printf("%s: invalid argument %s\n", pgm, argv[argno]);
       showHelpAndExit();
     }
   } /* for */
 
+#ifdef WITHSTATS
+  if (opts->stats || opts->traceFile)
+    startStats(opts->traceFile, opts->stats);
+#endif
+
   /* set dest path */
   if (!drivearg)
     showHelpAndExit();
+#ifdef __unix__
+  /* assign a drive letter to image, device, or partition of either */
+  {
+    unsigned drive = mapDrive(argv[drivearg]);
+
+    if (drive >= 26 || !isImageDrive(drive))
+    {
+      printf("%s: destination %s must be a disk image or device\n", pgm, argv[drivearg]);
+      exit(1);
+    }
+    opts->dstDrive = (BYTE)drive;
+  }
+#else
   opts->dstDrive = (BYTE)(toupper(*(argv[drivearg])) - 'A');
+#endif
   if (/* (opts->dstDrive < 0) || */ (opts->dstDrive >= 26))
   {
     printf("%s: drive %c must be A:..Z:\n", pgm, *(argv[drivearg]));
@@ -504,11 +645,61 @@ void initOptions(int argc, char *argv[], SYSOptions *opts)
       opts->bsFile = "/FREEDOS.BSS";
   }
 #endif
+
+  /* build list of destinations, drive argument is always 1st */
+  opts->dstDrives[0] = opts->dstDrive;
+  opts->dstCount = 1;
+#ifdef __unix__
+  /* host build, list of images separated by commas */
+  for (drives = drives ? strtok(drives, ",") : NULL; drives; drives = strtok(NULL, ","))
+  {
+    unsigned drive = mapDrive(drives);
+    if (drive >= 26 || !isImageDrive(drive))
+    {
+      printf("%s: too many destinations or %s not a disk image\n", pgm, drives);
+      exit(1);
+    }
+    if (memchr(opts->dstDrives, drive, opts->dstCount) != NULL)
+      printf("%s: %s is already a destination, skipped\n", pgm, drives);
+    else
+      opts->dstDrives[opts->dstCount++] = (BYTE)drive;
+  }
+#else
+  for (; drives && *drives; drives++)
+  {
+    unsigned drive;
+    if (*drives == ':' || *drives == ',' || *drives == ';')
+      continue;
+    drive = toupper(*drives) - 'A';
+    if (drive >= 26)
+    {
+      printf("%s: drive %c must be A:..Z:\n", pgm, *drives);
+      exit(1);
+    }
+    if (memchr(opts->dstDrives, drive, opts->dstCount) == NULL)
+      opts->dstDrives[opts->dstCount++] = (BYTE)drive;
+  }
+#endif
+  if (opts->dstCount > 1 && opts->bsFile)
+  {
+    printf("%s: /DRIVES can not be used with a boot sector file or /BOOTMGR\n", pgm);
+    showHelpAndExit();
+  }
   
   /* if neither BOTH nor a boot sector file specified, then write to boot record */
   if (!opts->bsFile)
     opts->writeBS = 1;
 
+#ifdef __unix__
+  /* set source path, default to current directory */
+  if (srcarg)
+  {
+    strncpy(opts->srcDrive, argv[srcarg], SYS_MAXPATH-14);
+    opts->srcDrive[SYS_MAXPATH-14] = '\0';
+    if (opts->srcDrive[strlen(opts->srcDrive)-1] != '/')
+      strcat(opts->srcDrive, "/");
+  }
+#else
   /* set source path, default to current drive */
   sprintf(opts->srcDrive, "%c:", 'A' + getcurdrive());
   if (srcarg)
@@ -526,6 +717,7 @@ void initOptions(int argc, char *argv[], SYSOptions *opts)
     if ((slen>2) && (opts->srcDrive[slen-1] != '\\') && (opts->srcDrive[slen-1] != '/'))
       strcat(opts->srcDrive, "\\");
   }
+#endif
   /* source path is now in form of just a drive, "X:" 
      or form of drive + path + directory separator, "X:\path\" or "\\path\"
      If just drive we try current path then root, else just indicated path.
@@ -548,14 +740,14 @@ void initOptions(int argc, char *argv[], SYSOptions *opts)
     {
       /* look for existing file matching kernel filename */
       sprintf(srcFile, "%s%s", opts->srcDrive, bootFiles[argno].kernel);
-      if (stat(srcFile, &fstatbuf)) continue; /* if !exists() try again */
+      if (timedStat(srcFile, &fstatbuf)) continue; /* if !exists() try again */
       if (!fstatbuf.st_size) continue;  /* file must not be empty */
 
       /* now check if secondary file exists and of minimal size */
       if (bootFiles[argno].minsize)
       {
         sprintf(srcFile, "%s%s", opts->srcDrive, bootFiles[argno].dos);
-        if (stat(srcFile, &fstatbuf)) continue;
+        if (timedStat(srcFile, &fstatbuf)) continue;
         if (fstatbuf.st_size < bootFiles[argno].minsize) continue;
       }
 
@@ -571,14 +763,14 @@ void initOptions(int argc, char *argv[], SYSOptions *opts)
       {
         /* look for existing file matching kernel filename */
         sprintf(srcFile, "%s\\%s", opts->srcDrive, bootFiles[argno].kernel);
-        if (stat(srcFile, &fstatbuf)) continue; /* if !exists() try again */
+        if (timedStat(srcFile, &fstatbuf)) continue; /* if !exists() try again */
         if (!fstatbuf.st_size) continue;  /* file must not be empty */
 
         /* now check if secondary file exists and of minimal size */
         if (bootFiles[argno].minsize)
         {
           sprintf(srcFile, "%s\\%s", opts->srcDrive, bootFiles[argno].dos);
-          if (stat(srcFile, &fstatbuf)) continue;
+          if (timedStat(srcFile, &fstatbuf)) continue;
           if (fstatbuf.st_size < bootFiles[argno].minsize) continue;
         }
 
@@ -608,17 +800,10 @@ void initOptions(int argc, char *argv[], SYSOptions *opts)
   opts->kernel.minsize = bootFiles[opts->flavor].minsize;
 
 
-  /* did user insist on always using BIOS provided drive # */
-  if (opts->ignoreBIOS == -1)
-    opts->ignoreBIOS = 0;  /* its really a boolean value in rest of code */
-  /* if destination is floppy (A: or B:) then use drive # stored in boot sector */
-  else if (opts->dstDrive < 2)
-    opts->ignoreBIOS = 1;
-
-  /* if bios drive to store in boot sector not set and not floppy set to 1st hd */
-  if (!opts->defBootDrive && (opts->dstDrive >= 2))
-    opts->defBootDrive = 0x80;
-  /* else opts->defBootDrive = 0x0; the 1st floppy */
+  /* keep settings as given, defaults depend on destination drive */
+  opts->userIgnoreBIOS = opts->ignoreBIOS;
+  opts->userBootDrive = opts->defBootDrive;
+  setDestination(opts, opts->dstDrive);
 
   
   /* if nonstandard action, perform action and exit */
@@ -636,11 +821,11 @@ void initOptions(int argc, char *argv[], SYSOptions *opts)
   {
     /* check kernel (primary file) 1st */
     sprintf(srcFile, "%s%s", opts->srcDrive, (opts->fnKernel)?opts->fnKernel:opts->kernel.kernel);
-    if (stat(srcFile, &fstatbuf))  /* if !exists() */
+    if (timedStat(srcFile, &fstatbuf))  /* if !exists() */
     {
       /* check root path as well if src is drive only */
       sprintf(srcFile, "%s\\%s", opts->srcDrive, (opts->fnKernel)?opts->fnKernel:opts->kernel.kernel);
-      if (opts->srcDrive[2] || stat(srcFile, &fstatbuf))
+      if (opts->srcDrive[2] || timedStat(srcFile, &fstatbuf))
       {
         printf("%s: failed to find kernel file %s\n", pgm, (opts->fnKernel)?opts->fnKernel:opts->kernel.kernel);
         exit(1);
@@ -653,7 +838,7 @@ void initOptions(int argc, char *argv[], SYSOptions *opts)
     if (opts->kernel.dos && opts->kernel.minsize)
     {
       sprintf(srcFile, "%s%s", opts->srcDrive, opts->kernel.dos);
-      if (stat(srcFile, &fstatbuf))
+      if (timedStat(srcFile, &fstatbuf))
       {
         printf("%s: failed to find source file %s\n", pgm, opts->kernel.dos);
         exit(1);
@@ -671,11 +856,11 @@ void initOptions(int argc, char *argv[], SYSOptions *opts)
   {
     /* lastly check for command interpreter, 1st try source path, then try %COMSPEC% */
     sprintf(srcFile, "%s%s", opts->srcDrive, (opts->fnCmd)?opts->fnCmd:"COMMAND.COM");
-    if (stat(srcFile, &fstatbuf))  /* if !exists() */
+    if (timedStat(srcFile, &fstatbuf))  /* if !exists() */
     {
       char *comspec = getenv("COMSPEC");
       /* don't use comspec if shell filename specified, comspec env var not found, or file pointed to not exists */
-      if (opts->fnCmd || (comspec == NULL) || stat(comspec, &fstatbuf))
+      if (opts->fnCmd || (comspec == NULL) || timedStat(comspec, &fstatbuf))
       {
         printf("%s: failed to find command interpreter (shell) file %s\n", pgm, srcFile);
         exit(1);
@@ -0,0 +1,226 @@
+/***************************************************************
+
+                                    manifest.c
+                                    DOS-C
+
+                            sys utility for DOS-C
+
+                             Copyright (c) 1991
+                             Pasquale J. Villani
+                             All Rights Reserved
+
+ This file is part of DOS-C.
+
+ DOS-C is free software; you can redistribute it and/or modify it under the
+ terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ DOS-C is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ details.
+
+ You should have received a copy of the GNU General Public License along with
+ DOS-C; see the file COPYING.  If not, write to the Free Software Foundation,
+ 675 Mass Ave, Cambridge, MA 02139, USA.
+
+***************************************************************/
+
+/* copies additional files listed in a manifest file after the system
+   files, each line is
+     source [destination]
+   where destination is relative to root of drive being SYS'd and
+   defaults to the source's filename; blank lines and lines starting
+   with ; or # are ignored.  Disk images (host build) are only written
+   in their root directory, so there destination may not have a path.
+*/
+
+#include "sys.h"
+#include "diskio.h"
+
+#define MAX_MANIFEST  64        /* most files listed */
+#define MANIFEST_SIZE 4096      /* largest manifest file */
+
+typedef struct {
+  const char *source;
+  const char *dest;
+  ULONG size;
+} ManifestEntry;
+
+static char manifestText[MANIFEST_SIZE + 1];
+static ManifestEntry entries[MAX_MANIFEST];
+static int entryCount = -1;     /* -1 until manifest loaded */
+static ULONG totalSize;
+
+
+/* returns length of directory portion of path, including final separator */
+static unsigned dirLength(const char *path)
+{
+  unsigned len = strlen(path);
+
+  while (len && path[len-1] != '\\' && path[len-1] != '/' && path[len-1] != ':')
+    len--;
+  return len;
+}
+
+/* compare directory portion of two paths, ignoring case */
+static int compareDirs(const char *a, const char *b)
+{
+  unsigned alen = dirLength(a), blen = dirLength(b);
+  int diff = memicmp(a, b, (alen < blen) ? alen : blen);
+
+  return diff ? diff : (int)alen - (int)blen;
+}
+
+/* skips spaces and tabs, returns pointer to next character */
+static char *skipBlanks(char *p)
+{
+  while (*p == ' ' || *p == '\t')
+    p++;
+  return p;
+}
+
+/* terminates word at p, returns pointer to character after it */
+static char *endWord(char *p)
+{
+  while (*p && *p != ' ' && *p != '\t' && *p != '\r')
+    p++;
+  if (*p)
+    *p++ = '\0';
+  return p;
+}
+
+/* reads and parses manifest, sorts entries by source directory so files
+   from the same directory are copied together, and totals their sizes */
+static BOOL loadManifest(const char *fname)
+{
+  struct stat fstatbuf;
+  char *line, *next, *p;
+  int fd, len, i, j;
+
+  if ((fd = open(fname, O_RDONLY | O_BINARY)) < 0)
+  {
+    printf("%s: failed to open manifest \"%s\"\n", pgm, fname);
+    return FALSE;
+  }
+  len = read(fd, manifestText, MANIFEST_SIZE + 1);
+  close(fd);
+  if (len < 0 || len > MANIFEST_SIZE)
+  {
+    printf("%s: manifest \"%s\" unreadable or larger than %u bytes\n", pgm, fname, MANIFEST_SIZE);
+    return FALSE;
+  }
+  manifestText[len] = '\0';
+
+  entryCount = 0;
+  totalSize = 0;
+  for (line = manifestText; line != NULL; line = next)
+  {
+    ManifestEntry e;
+
+    if ((next = strchr(line, '\n')) != NULL)
+      *next++ = '\0';
+    p = skipBlanks(line);
+    if (!*p || *p == ';' || *p == '#' || *p == '\r')
+      continue;
+
+    e.source = p;
+    p = skipBlanks(endWord(p));
+    if (*p && *p != '\r')
+    {
+      e.dest = p;
+      endWord(p);
+    }
+    else  /* default to same filename in root */
+      e.dest = e.source + dirLength(e.source);
+
+    if (timedStat(e.source, &fstatbuf))
+    {
+      printf("%s: failed to find manifest file %s\n", pgm, e.source);
+      return FALSE;
+    }
+    e.size = fstatbuf.st_size;
+    totalSize += e.size;
+
+    if (entryCount >= MAX_MANIFEST)
+    {
+      printf("%s: too many files in manifest, at most %u\n", pgm, MAX_MANIFEST);
+      return FALSE;
+    }
+    /* insert keeping sorted by source directory, stable otherwise */
+    for (j = entryCount; j > 0 && compareDirs(entries[j-1].source, e.source) > 0; j--)
+      entries[j] = entries[j-1];
+    entries[j] = e;
+    entryCount++;
+  }
+
+  for (i = 0; i < entryCount; i++)
+    if (!*entries[i].dest)
+    {
+      printf("%s: manifest entry %s has no filename\n", pgm, entries[i].source);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+
+/* copies all files listed in opts->manifest to destination drive,
+   returns FALSE if any file could not be copied */
+BOOL copyManifest(SYSOptions *opts)
+{
+  ULONG start, elapsed, written;
+  int i;
+  BOOL ok = TRUE;
+
+  /* manifest is only read once, even for several destinations */
+  if (entryCount < 0 && !loadManifest(opts->manifest))
+  {
+    entryCount = -1;
+    return FALSE;
+  }
+
+#ifdef __unix__
+  /* refuse before copying any, rather than fail part way through */
+  if (isImageDrive(opts->dstDrive))
+    for (i = 0; i < entryCount; i++)
+      if (dirLength(entries[i].dest))
+      {
+        printf("%s: manifest destination %s is in a subdirectory, images only take\n"
+               "files in their root directory\n", pgm, entries[i].dest);
+        return FALSE;
+      }
+#endif
+
+  printf("Copying %d file(s) from manifest %s...\n", entryCount, opts->manifest);
+
+  /* one free space check for all files instead of one per file */
+  if (!check_space(opts->dstDrive, totalSize))
+  {
+    printf("%s: Not enough space to transfer %lu bytes of manifest files\n", pgm,
+           (unsigned long)totalSize);
+    return FALSE;
+  }
+  opts->spaceChecked = TRUE;
+
+  written = opts->written;
+  start = getTicks();
+  for (i = 0; i < entryCount && ok; i++)
+  {
+    if (!copy(entries[i].source, opts->dstDrive, entries[i].dest, opts))
+    {
+      printf("%s: cannot copy \"%s\"\n", pgm, entries[i].source);
+      ok = FALSE;
+    }
+  }
+  elapsed = TICKS_TO_MS(getTicks() - start);
+  opts->spaceChecked = FALSE;
+
+  /* aggregate throughput of manifest files */
+  written = opts->written - written;
+  printf("Manifest: %d file(s), %lu Bytes transferred", i, (unsigned long)written);
+  if (elapsed)
+    printf(", %lu bytes/sec", (unsigned long)bytesPerSec(written, elapsed));
+  printf("\n");
+
+  return ok;
+}
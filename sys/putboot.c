@@ -28,6 +28,7 @@
 
 #include "sys.h"
 #include "diskio.h"
+#include "fatio.h"
 
 #include "fat12com.h"
 #include "fat16com.h"
@@ -50,60 +51,6 @@
 #define SEC_SIZE        512
 
 
-struct bootsectortype {
-  UBYTE bsJump[3];
-  char OemName[8];
-  UWORD bsBytesPerSec;
-  UBYTE bsSecPerClust;
-  UWORD bsResSectors;
-  UBYTE bsFATs;
-  UWORD bsRootDirEnts;
-  UWORD bsSectors;
-  UBYTE bsMedia;
-  UWORD bsFATsecs;
-  UWORD bsSecPerTrack;
-  UWORD bsHeads;
-  ULONG bsHiddenSecs;
-  ULONG bsHugeSectors;
-  UBYTE bsDriveNumber;
-  UBYTE bsReserved1;
-  UBYTE bsBootSignature;
-  ULONG bsVolumeID;
-  char bsVolumeLabel[11];
-  char bsFileSysType[8];
-};
-
-struct bootsectortype32 {
-  UBYTE bsJump[3];
-  char OemName[8];
-  UWORD bsBytesPerSec;
-  UBYTE bsSecPerClust;
-  UWORD bsResSectors;
-  UBYTE bsFATs;
-  UWORD bsRootDirEnts;
-  UWORD bsSectors;
-  UBYTE bsMedia;
-  UWORD bsFATsecs;
-  UWORD bsSecPerTrack;
-  UWORD bsHeads;
-  ULONG bsHiddenSecs;
-  ULONG bsHugeSectors;
-  ULONG bsBigFatSize;
-  UBYTE bsFlags;
-  UBYTE bsMajorVersion;
-  UWORD bsMinorVersion;
-  ULONG bsRootCluster;
-  UWORD bsFSInfoSector;
-  UWORD bsBackupBoot;
-  ULONG bsReserved2[3];
-  UBYTE bsDriveNumber;
-  UBYTE bsReserved3;
-  UBYTE bsExtendedSignature;
-  ULONG bsSerialNumber;
-  char bsVolumeLabel[11];
-  char bsFileSystemID[8];
-};
-
 /*
  * globals needed by put_boot & check_space
  */
@@ -154,8 +101,9 @@ VOID dump_sector(unsigned char far * sec)
 
 typedef enum {read_bs = 0, write_bs = 1} readWriteMode;
 
-/* reads or writes boot sector (1st SEC_SIZE bytes) from file */
-static void read_write_BS_file(const char *bsFile, UBYTE *bootsector, readWriteMode mode)
+/* reads or writes boot sector (1st SEC_SIZE bytes) from file,
+   returns FALSE (after printing why) if the file could not be accessed */
+static BOOL read_write_BS_file(const char *bsFile, UBYTE *bootsector, readWriteMode mode)
 {
   if (bsFile != NULL)
   {
@@ -173,8 +121,8 @@ static void read_write_BS_file(const char *bsFile, UBYTE *bootsector, readWriteM
         fd = open(bsFile, O_RDONLY | O_BINARY);
     if (fd < 0)
     {
-      printf("%s: can't open\"%s\"\nDOS errnum %d", pgm, bsFile, errno);
-      exit(1);
+      printf("%s: can't open\"%s\"\nDOS errnum %d\n", pgm, bsFile, errno);
+      return FALSE;
     }
     /* read/write only SEC_SIZE bytes to support reading/writing from both
        boot sector files and raw disk images
@@ -184,11 +132,12 @@ static void read_write_BS_file(const char *bsFile, UBYTE *bootsector, readWriteM
       printf("%s: failed to %s %u bytes from %s\n", pgm, mode?"write":"read", SEC_SIZE, bsFile);
       close(fd);
       /* unlink(bsFile); don't delete in case was image */
-      exit(1);
+      return FALSE;
     }
     /* we are done, so close file */
     close(fd);
   }
+  return TRUE;
 }
 
 /* reads in boot sector (1st SEC_SIZE bytes) from file */
@@ -197,8 +146,9 @@ static void read_write_BS_file(const char *bsFile, UBYTE *bootsector, readWriteM
 #define saveBS(bsFile, bootsector) read_write_BS_file(bsFile, bootsector, write_bs)
 
 
-/* reads or writes boot sector (1st SEC_SIZE bytes) to/from drive */
-void read_write_BS_drive(unsigned drive, UBYTE *bootsector, readWriteMode mode, ULONG sector)
+/* reads or writes boot sector (1st SEC_SIZE bytes) to/from drive,
+   returns FALSE (after printing why) if the transfer failed */
+BOOL read_write_BS_drive(unsigned drive, UBYTE *bootsector, readWriteMode mode, ULONG sector)
 {
   #ifdef DEBUG
   const char *msg = "%s sector %lu on drive %c:\n";
@@ -212,19 +162,22 @@ void read_write_BS_drive(unsigned drive, UBYTE *bootsector, readWriteMode mode,
   }
   #endif
 
-  /* obtain exclusive access to drive */
-  lockDrive(drive);
+  /* obtain exclusive access to drive, unless caller already has */
+  beginDriveAccess(drive);
 
   /* suggestion: allow reading from a boot sector or image file here */
-  /* read/write bootsector to drive */
-  if (MyAbsReadWrite(drive, 1, sector, bootsector, mode?1:0) != 0)
+  /* read/write bootsector to drive, written out with any other cached
+     sectors (backup boot sector, root directory) when drive unlocked */
+  if (cacheReadWrite(drive, 1, sector, bootsector, mode) != 0)
   {
-    printf("%s: failed to %s sector %lu on drive %c:\n", pgm, mode?"write":"read", sector, drive + 'A');
-    exit(1);
+    printf("%s: failed to %s sector %lu on drive %c:\n", pgm, mode?"write":"read",
+           (unsigned long)sector, drive + 'A');
+    endDriveAccess(drive);
+    return FALSE;
   }
 
-  /* release lock */
-  unLockDrive(drive);
+  /* release lock, if we took it */
+  endDriveAccess(drive);
 
   #ifdef DEBUG
   if (mode==read_bs)
@@ -235,6 +188,7 @@ void read_write_BS_drive(unsigned drive, UBYTE *bootsector, readWriteMode mode,
     #endif
   }
   #endif
+  return TRUE;
 }
 
 /* reads in boot sector (1st SEC_SIZE bytes) from drive */
@@ -242,24 +196,39 @@ void read_write_BS_drive(unsigned drive, UBYTE *bootsector, readWriteMode mode,
 /* write bootsector to (1st SEC_SIZE bytes) of drive */
 #define saveDriveBS(drive, bootsector) read_write_BS_drive(drive, bootsector, write_bs, 0)
 
-/* writes boot sector to backup location on drive */
-void saveDriveBackupBS(SYSOptions *opts, UBYTE *bootsector)
+/* boot sector as read from drive, before any changes */
+static UBYTE origboot[SEC_SIZE];
+
+/* writes boot sector to backup location on drive, FALSE on failure */
+BOOL saveDriveBackupBS(SYSOptions *opts, UBYTE *bootsector)
 {
 #ifdef WITHFAT32
     /* for FAT32, we need to update the backup copy as well */
     /* unless user has asked us not to, eg for better dual boot support */
     /* Note: assuming sectors 1-5 (FSINFO+additional boot code) & 7-11 (backup copy) 
        are properly setup by prior format and need no modification
-       [technically freespace, etc. should be updated]
+       [freespace, etc. in FSINFO is updated after files copied, see updateFSInfo]
     */
     if (opts->fs == FAT32)
     {
       struct bootsectortype32 *bs32 = (struct bootsectortype32 *)bootsector;
+      if (opts->incremental)
+      {
+        UBYTE backup[SEC_SIZE];
+        if (!read_write_BS_drive(opts->dstDrive, backup, read_bs, bs32->bsBackupBoot))
+          return FALSE;
+        if (memcmp(backup, bootsector, SEC_SIZE) == 0)
+        {
+          printf("Backup boot sector unchanged\n");
+          return TRUE;
+        }
+      }
       if (opts->verbose)
         printf("Writing backup bootsector to sector %d\n", bs32->bsBackupBoot);
-      read_write_BS_drive(opts->dstDrive, bootsector, write_bs, bs32->bsBackupBoot);
+      return read_write_BS_drive(opts->dstDrive, bootsector, write_bs, bs32->bsBackupBoot);
     }
 #endif 
+  return TRUE;
 }
 
 
@@ -275,102 +244,119 @@ static void printFilename(BYTE *n)
   printf("{%s}\n", fname);
 }
 
-static void setFilename(char *buffer, char const *filename)
-{
-  int i;
-  /* pad with spaces, if name.ext is less than 8.3 blanks filled with spaces */
-  memset(buffer, ' ', 11);
-  /* copy over up to 8 characters of filename and 3 characters of extension */
-  for (i = 0; *filename && (*filename != '.'); i++, filename++)
-    if (i<FNAME_SIZE) buffer[i] = toupper(*filename);
-  if (*filename == '.')
-  {
-    filename++; /* skip past . */
-    for (i = 8; (i < 11) && *filename; i++, filename++)
-      buffer[i] = toupper(*filename);
-  }  
-}
+#define sameSlot(a, b) ((a).sector == (b).sector && (a).offset == (b).offset)
 
-/* for FAT12/16 rearranges root directory so kernel & dos files are 1st two entries */
+/* rearranges root directory so kernel & dos files are 1st two entries; root
+   is read a cluster at a time (FAT12/16 fixed root in one transfer) with
+   the entries found in a single pass, then only changed entries written */
 void updateRootDir(SYSOptions *opts)
 {
+  static FATVolume vol;
   struct dirent *dir;
   struct lfn_entry *lfn;
-  BYTE buffer[SEC_SIZE];
-  BYTE kname[FNAME_SIZE+FEXT_SIZE];
-  BYTE dname[FNAME_SIZE+FEXT_SIZE];
-  ULONG sectnum, lastsect;
-  BYTE entry1[DIRENT_SIZE], entry2[DIRENT_SIZE];
-  int dirty = 0;
-  
+  BYTE FAR *block;
+  BYTE names[2][FNAME_SIZE+FEXT_SIZE];
+  struct dirent entry, first[2], file[2];
+  DirSlot firstSlot[2], fileSlot[2];
+  DirPos pos;
+  ULONG n, entries;
+  BOOL more, end = FALSE, firstBlock = TRUE;
+  unsigned i;
+
+  if (opts->verbose)
+    printf("[%s and %s]\n", opts->kernel.kernel, opts->kernel.dos);
+
   /* convert ASCIIZ 8.3 format to 83 space filled format same as dirent */
-  printf("[%s and %s]\n", opts->kernel.kernel, opts->kernel.dos);
-  setFilename(kname, opts->kernel.kernel);
-  setFilename(dname, opts->kernel.dos);
-  
-  /* loop through all root dir sectors */
-  lastsect = opts->rootSector + opts->rootDirSectors;
-  for (sectnum = opts->rootSector; sectnum < lastsect; sectnum++)
+  setFilename(names[0], opts->kernel.kernel);
+  if (opts->kernel.dos)
+    setFilename(names[1], opts->kernel.dos);
+  fileSlot[0].sector = fileSlot[1].sector = 0;
+
+  if (!openVolume(&vol, opts->dstDrive) || !firstRootSector(&vol, &pos))
   {
-    /* read in sector */
-    if (MyAbsReadWrite(opts->dstDrive, 1, sectnum, buffer, 0) != 0)
-    {
-      printf("Error reading root directory, not updated!\n");
-      return;
-    }
-    
-    /* store 1st two directory entries */
-    if (sectnum == opts->rootSector)
+    printf("Error reading root directory, not updated!\n");
+    return;
+  }
+  /* fixed root or 1st cluster is the largest block read */
+  if ((block = allocBlock((ULONG)pos.left * SEC_SIZE)) == NULL)
+  {
+    printf("Not enough memory for root directory, not updated!\n");
+    return;
+  }
+
+  /* find kernel and dos entries, stopping at end of directory entries */
+  for (more = TRUE; more && !end; more = nextDirCluster(&vol, &pos))
+  {
+    if (cacheReadWrite(vol.drive, pos.left, pos.sector, block, 0) != 0)
     {
-      memcpy(entry1, buffer, DIRENT_SIZE);
-      memcpy(entry2, buffer+DIRENT_SIZE, DIRENT_SIZE);
+      vol.ioError = TRUE;
+      break;
     }
-    
-    /* loop through directory entries until kernel found or last entry found */
-    for (dir = (struct dirent *)buffer; dir < (struct dirent *)(buffer + SEC_SIZE); dir++)
+    entries = (ULONG)pos.left * (SEC_SIZE / DIRENT_SIZE);
+    for (n = 0; n < entries; n++)
     {
+      DirSlot slot;
+
+      hugeMove((BYTE FAR *)&entry, hugeAdd(block, n * DIRENT_SIZE), DIRENT_SIZE);
+      slot.sector = pos.sector + n / (SEC_SIZE / DIRENT_SIZE);
+      slot.offset = (UWORD)(n % (SEC_SIZE / DIRENT_SIZE) * DIRENT_SIZE);
+      if (firstBlock && n < 2)  /* entries to swap with */
+      {
+        first[n] = entry;
+        firstSlot[n] = slot;
+      }
+      dir = &entry;
       if (*(dir->dir_name) == '\0') /* end of directy entries reached */
+      {
+        end = TRUE;
         break;
+      }
 
       lfn = (struct lfn_entry *)dir;
       if (lfn->lfn_attrib == D_LFN)
       {
-        printf("lfn id:%u\n", lfn->lfn_id & (~0x40));
+        if (opts->verbose)
+          printf("lfn id:%u\n", lfn->lfn_id & (~0x40));
+        continue;
       }
-      else
+      for (i = 0; i < 2; i++)
       {
-        /* swap directory entries if kernel/dos files found */
-        if (memcmp(dir->dir_name, kname,11)==0)
-        {
-          printf("Found kernel\n");
-          memcpy(buffer, dir, DIRENT_SIZE);
-          memcpy(dir, entry1, DIRENT_SIZE);
-          dirty++;
-        }
-        if (memcmp(dir->dir_name, dname,11)==0)
+        if ((i == 0 || opts->kernel.dos) && memcmp(dir->dir_name, names[i], 11) == 0)
         {
-          printf("Found dos\n");
-          memcpy(buffer+DIRENT_SIZE, dir, DIRENT_SIZE);
-          memcpy(dir, entry2, DIRENT_SIZE);
-          dirty++;
+          file[i] = entry;
+          fileSlot[i] = slot;
         }
-        printFilename(dir->dir_name);
       }
+      if (opts->verbose)
+        printFilename(dir->dir_name);
     }
+    firstBlock = FALSE;
+  }
+  freeBlock(block);
+  if (vol.ioError)
+  {
+    printf("Error reading root directory, not updated!\n");
+    return;
+  }
 
-    /* write sector if changed */
-    if (dirty)
+  /* kernel to 1st entry, then dos to 2nd (following it if it was 1st) */
+  for (i = 0; i < 2; i++)
+  {
+    if (!fileSlot[i].sector || sameSlot(fileSlot[i], firstSlot[i]))
+      continue;
+    if (opts->verbose)
+      printf("Moving %s to entry %u\n", i ? "dos" : "kernel", i);
+    entry = first[i];
+    if (!writeDirEntry(&vol, &firstSlot[i], &file[i]) ||
+        !writeDirEntry(&vol, &fileSlot[i], &entry))
     {
-      if (MyAbsReadWrite(opts->dstDrive, 1, sectnum, buffer, 1) != 0)
-      {
-        printf("Error writing root directory, not updated!\n");
-        return;
-      }
-      dirty = 0;
-    }    
-
-    if (*(dir->dir_name) == '\0') /* end of directy entries reached */
-        break;
+      printf("Error writing root directory, not updated!\n");
+      return;
+    }
+    if (i == 0 && sameSlot(fileSlot[1], firstSlot[0]))
+      fileSlot[1] = fileSlot[0];
+    if (i == 0 && sameSlot(fileSlot[0], firstSlot[1]))
+      first[1] = entry;
   }
 }
 #endif
@@ -382,8 +368,14 @@ void updateRootDir(SYSOptions *opts)
 void correct_bpb(FileSystem fs, unsigned drive, struct bootsectortype *oldboot, BOOL verbose)
 {
   UBYTE default_bpb_buffer[0x5c];
-  struct bootsectortype *default_bpb;
-  char *valuesMsg = " boot sector values: % sectors/track: %u, heads: %u, hidden: %lu\n";
+  struct bootsectortype default_bpb;
+  char *valuesMsg = "%s boot sector values: sectors/track: %u, heads: %u, hidden: %lu\n";
+  BOOL given = FALSE;
+
+#ifdef __unix__
+  /* geometry given by /GEOMETRY is always used */
+  given = haveGeometry();
+#endif
 
   /* bit 0 set if function to use current BPB, clear if Device
            BIOS Parameter Block field contains new default BPB
@@ -393,30 +385,44 @@ void correct_bpb(FileSystem fs, unsigned drive, struct bootsectortype *oldboot,
   default_bpb_buffer[0] = 4;
 
   if (verbose)
-    printf(valuesMsg, "Old", oldboot->bsSecPerTrack, oldboot->bsHeads, oldboot->bsHiddenSecs);
+    printf(valuesMsg, "Old", oldboot->bsSecPerTrack, oldboot->bsHeads,
+           (unsigned long)oldboot->bsHiddenSecs);
 
   /* don't change bpb for floppies, otherwise get default bpb (no changes on error) */
-  if (drive < 2 || getDeviceParms(drive, fs, default_bpb_buffer) != 0)
+  if (drive < 2 && !given)
+  {
+    if (verbose)
+      printf(" Floppy, boot sector geometry kept\n");
+    return;
+  }
+  if (getDeviceParms(drive, fs, default_bpb_buffer) != 0)
       return;
   /* bpb returned beginning at byte 7 (+7), without the initial jump and and oemname field (-11) */
-  default_bpb = (struct bootsectortype *)(default_bpb_buffer + 7 - 11);
+  memcpy((UBYTE *)&default_bpb + 11, default_bpb_buffer + 7, sizeof(default_bpb) - 11);
 
 
   /* don't touch partitions (floppies most likely) that don't have hidden
      sectors */
-  if (default_bpb->bsHiddenSecs == 0)
+  if (default_bpb.bsHiddenSecs == 0 && !given)
+  {
+    if (verbose)
+      printf(" No hidden sectors, boot sector geometry kept (device reports %u sectors/track, %u heads)\n",
+             default_bpb.bsSecPerTrack, default_bpb.bsHeads);
     return;
+  }
 
-  oldboot->bsSecPerTrack = default_bpb->bsSecPerTrack;
-  oldboot->bsHeads = default_bpb->bsHeads;
-  oldboot->bsHiddenSecs = default_bpb->bsHiddenSecs;
+  oldboot->bsSecPerTrack = default_bpb.bsSecPerTrack;
+  oldboot->bsHeads = default_bpb.bsHeads;
+  oldboot->bsHiddenSecs = default_bpb.bsHiddenSecs;
   
   if (verbose)
-    printf(valuesMsg, "Using default ", oldboot->bsSecPerTrack, oldboot->bsHeads, oldboot->bsHiddenSecs);
+    printf(valuesMsg, "Using default", oldboot->bsSecPerTrack, oldboot->bsHeads,
+           (unsigned long)oldboot->bsHiddenSecs);
 }
 
 
-/* reads in current (old) boot sector, determine filesystem, and update CHS portion of BPB */
+/* reads in current (old) boot sector, determine filesystem, and update CHS portion of BPB,
+   returns UNKNOWN if the boot sector could not be read or is not supported */
 FileSystem get_old_bs(SYSOptions *opts, UBYTE *oldboot)
 {
 #ifdef WITHFAT32
@@ -431,13 +437,16 @@ FileSystem get_old_bs(SYSOptions *opts, UBYTE *oldboot)
   }
 
   /* get current boot sector */
-  readDriveBS(opts->dstDrive, oldboot);
+  if (!readDriveBS(opts->dstDrive, oldboot))
+    return UNKNOWN;
+  memcpy(origboot, oldboot, SEC_SIZE);
 
   /* backup original boot sector when requested */
   if (opts->bsFileOrig)
   {
     printf("Backing up current boot sector to %s\n", opts->bsFileOrig);
-    saveBS(opts->bsFileOrig, oldboot);
+    if (!saveBS(opts->bsFileOrig, oldboot))
+      return UNKNOWN;
   }
 
   /* alias bs structure to our sector buffer */
@@ -447,9 +456,13 @@ FileSystem get_old_bs(SYSOptions *opts, UBYTE *oldboot)
   {
     printf("Sector size is not 512 but %u bytes - not currently supported!\n",
       bs->bsBytesPerSec);
-    exit(1); /* Japan?! */
+    return UNKNOWN; /* Japan?! */
   }
 
+  /* on floppies keep merged sector transfers within a single track,
+     set for every drive so one installed to earlier doesn't carry over */
+  cacheTrackSize(opts->dstDrive, opts->dstDrive < 2 ? bs->bsSecPerTrack : 0);
+
   {
    /* see "FAT: General Overview of On-Disk Format" v1.02, 5.V.1999
     * (http://www.nondot.org/sabre/os/files/FileSystems/FatFormat.pdf)
@@ -486,9 +499,9 @@ FileSystem get_old_bs(SYSOptions *opts, UBYTE *oldboot)
 }
 
 /* copies appropriate boot code into newboot based on file system and options,
-   determines if chs, lba, or both are used
+   determines if chs, lba, or both are used; FALSE if none is suitable
 */
-void get_new_bs(SYSOptions *opts, UBYTE newboot[])
+BOOL get_new_bs(SYSOptions *opts, UBYTE newboot[])
 {
   register FileSystem fs = opts->fs;
   if (fs == FAT32)
@@ -500,7 +513,7 @@ void get_new_bs(SYSOptions *opts, UBYTE newboot[])
     {
       printf("%s: FAT32 versions of PC/MS DOS compatible boot sectors\n"
              "are not supported.\n", pgm);
-      exit(1);
+      return FALSE;
     }
 
     /* user may force explicity lba or chs, otherwise base on if LBA available */
@@ -511,7 +524,7 @@ void get_new_bs(SYSOptions *opts, UBYTE newboot[])
 #else
     printf("SYS hasn't been compiled with FAT32 support.\n"
            "Consider using -DWITHFAT32 option.\n");
-    exit(1);
+    return FALSE;
 #endif
   }
   else
@@ -545,7 +558,7 @@ void get_new_bs(SYSOptions *opts, UBYTE newboot[])
           else
           {
             printf("%s : fat boot sector does not match expected layout\n", pgm);
-            exit(1);
+            return FALSE;
           }
       }
     }
@@ -556,9 +569,11 @@ void get_new_bs(SYSOptions *opts, UBYTE newboot[])
       memcpy(newboot, (fs == FAT16) ? oemfat16 : oemfat12, SEC_SIZE);
 #else
       printf("Internal Error: no OEM compatible boot sector!\n");
+      return FALSE;
 #endif
     }
   }
+  return TRUE;
 }
 
 
@@ -574,8 +589,9 @@ void copy_disk_parameters(FileSystem fs, UBYTE oldboot[], UBYTE newboot[])
 }
 
 
-/* based on user options, patch portions of boot sector */
-void patch_bs(SYSOptions *opts, UBYTE newboot[])
+/* based on user options, patch portions of boot sector,
+   returns FALSE if the boot code does not match the expected layout */
+BOOL patch_bs(SYSOptions *opts, UBYTE newboot[])
 {
   int bsBiosMovOff;  /* offset in bs to mov [drive],dl that we NOP out */
   struct bootsectortype *bs = (struct bootsectortype *)newboot;
@@ -606,13 +622,13 @@ void patch_bs(SYSOptions *opts, UBYTE newboot[])
     */
     if (opts->kernel.stdbs)
     {
-      ((int *)newboot)[0x78/sizeof(int)] = opts->kernel.loadaddr;
+      ((UWORD *)newboot)[0x78/sizeof(UWORD)] = opts->kernel.loadaddr;
       bsBiosMovOff = 0x82;
     }
     else /* compatible bs */
     {
       printf("%s: INTERNAL ERROR: how did you get here?\n", pgm);
-      exit(1);
+      return FALSE;
     }
 
 #ifdef DEBUG
@@ -673,7 +689,7 @@ void patch_bs(SYSOptions *opts, UBYTE newboot[])
     else
     {
       printf("%s : fat boot sector does not match expected layout\n", pgm);
-      exit(1);
+      return FALSE;
     }
   }
 
@@ -694,6 +710,7 @@ void patch_bs(SYSOptions *opts, UBYTE newboot[])
     else
       printf("Boot sector kernel jmp address set to 70:%Xh\n", opts->kernel.loadaddr);
   }
+  return TRUE;
 }
 
 
@@ -703,91 +720,114 @@ void dumpBS(SYSOptions *opts)
 {
   UBYTE bootsector[SEC_SIZE];
 
-  /* load boot code for drive */
-  readDriveBS(opts->dstDrive, bootsector);
-
-  /* write out boot code to file */
-  saveBS(opts->altBSCode, bootsector);
+  /* load boot code for drive and write it out to file */
+  if (!readDriveBS(opts->dstDrive, bootsector) ||
+      !saveBS(opts->altBSCode, bootsector))
+    exit(1);
   
   printf("Boot sector retrieved.\n");
 }
 
 
-/* prepare boot sector and write it to drive's boot record */
+/* prepare boot sector and write it to drive's boot record,
+   returns NULL (after printing why) if any step failed */
 static UBYTE* storeBS(SYSOptions *opts, int updateBPB)
 {
   static UBYTE newboot[SEC_SIZE];
   UBYTE oldboot[SEC_SIZE];
+  BOOL ok;
   
+  /* lock drive once for reading and writing boot sector and its backup */
+  beginDriveAccess(opts->dstDrive);
+
   /* read existing boot sector to get BPB from previously formatted volume */
   opts->fs = get_old_bs(opts, oldboot);
+  ok = (opts->fs != UNKNOWN);
 
   /* load new boot code via external file or from compiled in resource */
-  if (opts->altBSCode)
+  if (ok && opts->altBSCode)
   {
   /* load boot code from file */
-    readBS(opts->altBSCode, newboot);
+    ok = readBS(opts->altBSCode, newboot);
     } 
-  else
+  else if (ok)
   {
     /* determine which built-in boot code to install based on kernel and other options */
-    get_new_bs(opts, newboot);
+    ok = get_new_bs(opts, newboot);
   }
 
-  if (updateBPB)
+  if (ok && updateBPB)
   {
     /* copy over BPB information so we can write it back again */
     copy_disk_parameters(opts->fs, oldboot, newboot);
   }
 
-  if (!opts->altBSCode)
+  if (ok && !opts->altBSCode)
   {
     /* update boot sector based on options selected */
-    patch_bs(opts, newboot);
+    ok = patch_bs(opts, newboot);
   }
 
-  if (opts->writeBS)
+  if (ok && opts->writeBS)
   {
-    if (opts->verbose)
-      printf("Writing new bootsector to drive %c:\n", opts->dstDrive + 'A');
-
+    /* skip rewriting an identical boot sector when incremental */
+    if (opts->incremental && memcmp(newboot, origboot, SEC_SIZE) == 0)
+      printf("Boot sector unchanged\n");
+    else
+    {
+      if (opts->verbose)
+        printf("Writing new bootsector to drive %c:\n", opts->dstDrive + 'A');
 
-    /* write newboot to a drive */
-    saveDriveBS(opts->dstDrive, newboot);
-    if (!opts->skipBakBSCopy)
-        saveDriveBackupBS(opts, newboot);
+      /* write newboot to a drive */
+      ok = saveDriveBS(opts->dstDrive, newboot);
+    }
+    if (ok && !opts->skipBakBSCopy)
+        ok = saveDriveBackupBS(opts, newboot);
    
   } /* if write boot sector to boot record*/
 
-  if (opts->bsFile != NULL)
+  if (ok && opts->bsFile != NULL)
   {
     if (opts->verbose)
       printf("Writing new bootsector to file %s\n", opts->bsFile);
 
-    saveBS(opts->bsFile, newboot);
+    ok = saveBS(opts->bsFile, newboot);
   } /* if write boot sector to file*/
 
-  return newboot;
+  endDriveAccess(opts->dstDrive);
+  return ok ? newboot : NULL;
 }
 
 /* write bs in bsFile to drive's boot record unmodified */
 void restoreBS(SYSOptions *opts)
 {
-  storeBS(opts, 0);
+  if (storeBS(opts, 0) == NULL)
+    exit(1);
   printf("Boot sector restored.\n");
 }
 
 /* write bs in bsFile to drive's boot record updating BPB */
 void putBS(SYSOptions *opts)
 {
-  storeBS(opts, 1);
+  if (storeBS(opts, 1) == NULL)
+    exit(1);
   printf("Finished putting boot sector.\n");
 }
 
-/* determines correct boot sector, patches, backup, and write new boot sector */
-void put_boot(SYSOptions *opts)
+/* determines correct boot sector, patches, backup, and write new boot sector,
+   returns FALSE if the boot sector could not be installed on this drive */
+BOOL put_boot(SYSOptions *opts)
 {
-  UBYTE *newboot = storeBS(opts, 1);
+  UBYTE *newboot;
+
+  /* whole boot sector and root directory update done under one lock */
+  beginDriveAccess(opts->dstDrive);
+  newboot = storeBS(opts, 1);
+  if (newboot == NULL)
+  {
+    endDriveAccess(opts->dstDrive);
+    return FALSE;
+  }
 
   if (opts->verbose) /* display information about filesystem */
   {
@@ -796,17 +836,20 @@ void put_boot(SYSOptions *opts)
   printf("Root dir entries = %u\n", bs->bsRootDirEnts);
 
   printf("FAT starts at sector (%lu + %u)\n",
-         bs->bsHiddenSecs, bs->bsResSectors);
+         (unsigned long)bs->bsHiddenSecs, bs->bsResSectors);
   printf("Root directory starts at sector (PREVIOUS + %u * %u)\n",
          bs->bsFATsecs, bs->bsFATs);
   }
   
 #ifdef WITHOEMCOMPATBS
-    /* if OEM and FAT12/16 then update root directory as well */
-    if ((opts->fs == FAT12 || opts->fs == FAT16) && (!opts->kernel.stdbs && !opts->altBSCode))
+    /* if OEM then update root directory as well; FAT32 has no built in
+       OEM boot sector, so there only for external boot code (/BSCODE) */
+    if (!opts->kernel.stdbs && (opts->fs == FAT32 || !opts->altBSCode))
     {
       updateRootDir(opts);
     }
 #endif
 
+  endDriveAccess(opts->dstDrive);
+  return TRUE;
 } /* put_boot */
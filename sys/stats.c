@@ -0,0 +1,191 @@
+/***************************************************************
+
+                                    stats.c
+                                    DOS-C
+
+                            sys utility for DOS-C
+
+                             Copyright (c) 1991
+                             Pasquale J. Villani
+                             All Rights Reserved
+
+ This file is part of DOS-C.
+
+ DOS-C is free software; you can redistribute it and/or modify it under the
+ terms of the GNU General Public License as published by the Free Software
+ Foundation; either version 2, or (at your option) any later version.
+
+ DOS-C is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ details.
+
+ You should have received a copy of the GNU General Public License along with
+ DOS-C; see the file COPYING.  If not, write to the Free Software Foundation,
+ 675 Mass Ave, Cambridge, MA 02139, USA.
+
+***************************************************************/
+
+/* I/O statistics: raw sector transfers, drive locks, and file operations
+   are counted along with the sectors or bytes moved and the time spent
+   (in getTicks() units, BIOS ticks under DOS so short operations often
+   show 0).  /STATS prints a table of the totals when the program exits,
+   /TRACE writes a line per operation to a file for later analysis.
+*/
+
+#include "sys.h"
+#include "diskio.h"
+
+#ifdef WITHSTATS
+
+#define TRACE_BUF  512              /* trace lines are written in blocks */
+#ifdef __unix__
+#define EOL "\n"
+#else
+#define EOL "\r\n"
+#endif
+
+typedef struct {
+  const char *name;
+  const char *units;                /* what amount counts */
+  ULONG count;                      /* operations done */
+  ULONG amount;                     /* sectors or bytes */
+  ULONG ticks;                      /* time spent doing them */
+} OpStats;
+
+static OpStats ops[STAT_OPS] = {
+  {"secread", "sectors"},
+  {"secwrite", "sectors"},
+  {"lock", "-"},
+  {"unlock", "-"},
+  {"open", "-"},
+  {"read", "bytes"},
+  {"write", "bytes"},
+  {"stat", "-"},
+};
+
+static BOOL statsWanted = FALSE;    /* print table at exit */
+static ULONG startTicks;            /* timestamps relative to this */
+static int traceFd = -1;
+static char traceBuf[TRACE_BUF];
+static unsigned traceUsed = 0;
+
+static void flushTrace(void)
+{
+  if (traceUsed)
+    write(traceFd, traceBuf, traceUsed);
+  traceUsed = 0;
+}
+
+/* adds text to trace, anything longer than the buffer (a long host
+   path) is cut short */
+static void trace(const char *line)
+{
+  size_t len = strlen(line);
+
+  if (traceUsed + len > TRACE_BUF)
+    flushTrace();
+  if (len > TRACE_BUF)
+    len = TRACE_BUF;
+  memcpy(traceBuf + traceUsed, line, len);
+  traceUsed += len;
+}
+
+/* adds one operation to totals, begins its trace line (if tracing) with
+   when it started and how long it took; FALSE if nothing to trace */
+static BOOL record(int op, ULONG start, ULONG amount, char *line)
+{
+  ULONG took = getTicks() - start;
+
+  ops[op].count++;
+  ops[op].amount += amount;
+  ops[op].ticks += took;
+  if (traceFd < 0)
+    return FALSE;
+  sprintf(line, "%lu %s %lu ", (unsigned long)TICKS_TO_MS(start - startTicks),
+          ops[op].name, (unsigned long)TICKS_TO_MS(took));
+  return TRUE;
+}
+
+static void statsAtExit(void)
+{
+  int i;
+
+  if (traceFd >= 0)
+  {
+    flushTrace();
+    close(traceFd);
+  }
+  if (!statsWanted)
+    return;
+
+  printf("\nOperation        Count      Amount  Units         ms\n");
+  for (i = 0; i < STAT_OPS; i++)
+    printf("%-12s  %8lu  %10lu  %-7s  %7lu\n", ops[i].name, (unsigned long)ops[i].count,
+           (unsigned long)ops[i].amount, ops[i].units, (unsigned long)TICKS_TO_MS(ops[i].ticks));
+  printf("Elapsed %lu ms\n", (unsigned long)TICKS_TO_MS(getTicks() - startTicks));
+}
+
+/* totals are always kept (so option parsing is counted too), this
+   arranges for them to be printed (if show) when the program exits and
+   starts writing the trace file (if traceFile not NULL) */
+void startStats(const char *traceFile, BOOL show)
+{
+  statsWanted = show;
+  startTicks = getTicks();
+  if (traceFile != NULL)
+  {
+    if ((traceFd = open(traceFile, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY,
+                        S_IREAD | S_IWRITE)) < 0)
+    {
+      printf("%s: can't create trace file %s\n", pgm, traceFile);
+      exit(1);
+    }
+    trace("# start(ms) operation elapsed(ms) amount target" EOL);
+  }
+  atexit(statsAtExit);
+}
+
+/* records sector transfer (count sectors at sector) or drive lock */
+void statDisk(int op, ULONG start, unsigned drive, ULONG sector, unsigned count)
+{
+  static char line[80];
+
+  if (!record(op, start, count, line))
+    return;
+  trace(line);
+  sprintf(line, "%u %c:%lu" EOL, count, 'A' + drive, (unsigned long)sector);
+  trace(line);
+}
+
+/* records file operation on name moving bytes bytes, or -1 if it failed */
+void statFile(int op, ULONG start, const char *name, ULONG bytes)
+{
+  static char line[80];
+  BOOL failed = (bytes == (ULONG)-1);
+
+  if (!record(op, start, failed ? 0 : bytes, line))
+    return;
+  trace(line);
+  if (failed)
+    trace("failed ");
+  else
+  {
+    sprintf(line, "%lu ", (unsigned long)bytes);
+    trace(line);
+  }
+  trace(name);
+  trace(EOL);
+}
+
+/* stat() that is counted */
+int timedStat(const char *path, struct stat *statbuf)
+{
+  ULONG start = getTicks();
+  int rc = stat(path, statbuf);
+
+  statFile(STAT_STAT, start, path, rc ? (ULONG)-1 : 0);
+  return rc;
+}
+
+#endif /* WITHSTATS */
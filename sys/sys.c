@@ -27,71 +27,207 @@
 ***************************************************************/
 
 #include "sys.h"
+#include "diskio.h"
 
 BYTE pgm[] = "SYS";
 
 
-int main(int argc, char **argv)
+/* copies a system file, contiguously if requested and possible */
+static BOOL copySysFile(SYSOptions *opts, const BYTE *source, const BYTE *filename)
 {
-  SYSOptions opts;            /* boot options and other flags */
-  BYTE srcFile[SYS_MAXPATH];  /* full path+name of [kernel] file [to copy] */
-
-  printf(SYS_NAME " System Installer " SYS_VERSION ", " __DATE__ "\n");
-
-#ifdef FDCONFIG
-  if (argc > 1 && memicmp(argv[1], "CONFIG", 6) == 0)
+#ifdef WITHCONTIG
+  if (opts->contig)
   {
-    exit(FDKrnConfigMain(argc, argv));
+    if (copyContig(source, opts->dstDrive, filename, opts))
+      return TRUE;
+    printf("%s: unable to write %s contiguously, using normal copy\n", pgm, filename);
   }
 #endif
+  return copy(source, opts->dstDrive, filename, opts);
+}
 
-  initOptions(argc, argv, &opts);
+
+/* full path+name of [kernel] files [to copy], source path plus
+   a file name possibly given on the command line (as initOptions) */
+static BYTE kernelFile[2 * SYS_MAXPATH];
+static BYTE dosFile[2 * SYS_MAXPATH];
+
+/* installs boot sector and system files to current destination drive,
+   returns FALSE if a required file could not be copied */
+static BOOL install(SYSOptions *opts)
+{
+  BOOL moved = FALSE, defragged = TRUE;
 
   printf("Processing boot sector...\n");
-  put_boot(&opts);
+  if (!put_boot(opts))
+  {
+    printf("%s: cannot install boot sector on drive %c:\n", pgm, opts->dstDrive + 'A');
+    return FALSE;
+  }
 
-  if (opts.copyKernel)
+  if (opts->copyKernel)
   {
     printf("Now copying system files...\n");
 
-    sprintf(srcFile, "%s%s", opts.srcDrive, (opts.fnKernel)?opts.fnKernel:opts.kernel.kernel);
-    if (!copy(srcFile, opts.dstDrive, opts.kernel.kernel))
+    if (!copySysFile(opts, kernelFile, opts->kernel.kernel))
     {
-      printf("%s: cannot copy \"%s\"\n", pgm, srcFile);
-      exit(1);
+      printf("%s: cannot copy \"%s\"\n", pgm, kernelFile);
+      return FALSE;
     } /* copy kernel */
 
-    if (opts.kernel.dos)
+    if (opts->kernel.dos)
     {
-      sprintf(srcFile, "%s%s", opts.srcDrive, opts.kernel.dos);
-      if (!copy(srcFile, opts.dstDrive, opts.kernel.dos) && opts.kernel.minsize)
+      if (!copySysFile(opts, dosFile, opts->kernel.dos) && opts->kernel.minsize)
       {
-        printf("%s: cannot copy \"%s\"\n", pgm, srcFile);
-        exit(1);
+        printf("%s: cannot copy \"%s\"\n", pgm, dosFile);
+        return FALSE;
       } /* copy secondary file (DOS) */
     }
   }
 
-  if (opts.copyShell)
+  if (opts->copyShell)
   {
     printf("Copying shell (command interpreter)...\n");
   
     /* full source path+name including possible use of COMSPEC determined during initOptions processing */
-    if (!copy(opts.fnCmd, opts.dstDrive, "COMMAND.COM"))
+    if (!copy(opts->fnCmd, opts->dstDrive, "COMMAND.COM", opts))
     {
-      printf("\n%s: failed to copy command interpreter (shell) file %s\n", pgm, opts.fnCmd);
-      exit(1);
+      printf("\n%s: failed to copy command interpreter (shell) file %s\n", pgm, opts->fnCmd);
+      return FALSE;
     } /* copy shell */
   }
+
+  if (opts->manifest)
+  {
+    if (!copyManifest(opts))
+      return FALSE;
+  }
+
+#ifdef WITHCONTIG
+  if (opts->defrag)
+    defragged = defragSystem(opts, &moved);
+#endif
+
+  /* free space hint in FAT32 FSInfo is stale after copying or moving files */
+  if (opts->fs == FAT32 && (opts->written || moved))
+    updateFSInfo(opts->dstDrive, opts->verbose);
+  if (!defragged)
+    return FALSE;
   
 #ifdef USEBOOTMANAGER
-  if (opts.addToBtMgr != NONE)
+  if (opts->addToBtMgr != NONE)
   {
-    if (!writeBootLoaderEntry(&opts))
+    if (!writeBootLoaderEntry(opts))
       printf("\n%s: failed to update boot manager\n", pgm);
   }
 #endif
 
-  printf("\nSystem transferred.\n");
-  return 0;
+  if (opts->verbose) /* raw disk access totals so far */
+  {
+    printf("Sector I/O: %lu sector(s) in %lu transfer(s), %lu drive lock(s)\n",
+           (unsigned long)ioRequests, (unsigned long)ioTransfers, (unsigned long)driveLocks);
+    if (cacheSectors)
+      printf("Sector cache: %u sectors, %lu hit(s), %lu miss(es), "
+             "%lu write(s) of which %lu to disk\n", cacheSectors,
+             (unsigned long)cacheHits, (unsigned long)cacheMisses,
+             (unsigned long)cacheWrites, (unsigned long)cacheWritten);
+  }
+
+  return TRUE;
+}
+
+
+int main(int argc, char **argv)
+{
+  SYSOptions opts;            /* boot options and other flags */
+  BOOL ok[26];                /* per destination results */
+  ULONG written[26], elapsed[26];
+  int i, failed = 0;
+
+  printf(SYS_NAME " System Installer " SYS_VERSION ", " __DATE__ "\n");
+
+#ifdef FDCONFIG
+  if (argc > 1 && memicmp(argv[1], "CONFIG", 6) == 0)
+  {
+    exit(FDKrnConfigMain(argc, argv));
+  }
+#endif
+
+  initOptions(argc, argv, &opts);
+
+  sprintf(kernelFile, "%s%s", opts.srcDrive, (opts.fnKernel)?opts.fnKernel:opts.kernel.kernel);
+  if (opts.kernel.dos)
+    sprintf(dosFile, "%s%s", opts.srcDrive, opts.kernel.dos);
+
+  if (opts.dstCount == 1)
+  {
+    if (!install(&opts))
+      exit(1);
+#ifdef __unix__
+    if (!syncDrives())
+      exit(1);
+#endif
+    printf("\nSystem transferred.\n");
+    return 0;
+  }
+
+  /* several destinations, read each source file only once */
+  if (opts.copyKernel)
+  {
+    cacheSource(kernelFile);
+    if (opts.kernel.dos)
+      cacheSource(dosFile);
+  }
+  if (opts.copyShell)
+    cacheSource(opts.fnCmd);
+
+  for (i = 0; i < opts.dstCount; i++)
+  {
+    ULONG start = getTicks();
+
+#ifdef __unix__
+    printf("\nInstalling to %s\n", drivePath(opts.dstDrives[i]));
+#else
+    printf("\nInstalling to drive %c:\n", 'A' + opts.dstDrives[i]);
+#endif
+    setDestination(&opts, opts.dstDrives[i]);
+    opts.written = 0;
+    ok[i] = install(&opts);
+    written[i] = opts.written;
+    elapsed[i] = TICKS_TO_MS(getTicks() - start);
+    if (!ok[i])
+      failed++;
+  }
+  freeSources();
+#ifdef __unix__
+  /* wait for all images together, then fail any whose writes failed */
+  syncDrives();
+  for (i = 0; i < opts.dstCount; i++)
+  {
+    if (ok[i] && driveFailed(opts.dstDrives[i]))
+    {
+      ok[i] = FALSE;
+      failed++;
+    }
+  }
+#endif
+
+#ifdef __unix__
+  /* drive letters are only assigned internally, show the images */
+  printf("\nResult        Bytes  Seconds  Image\n");
+  for (i = 0; i < opts.dstCount; i++)
+    printf("%-6s   %10lu  %4lu.%lu   %s\n",
+           ok[i] ? "OK" : "FAILED", (unsigned long)written[i],
+           (unsigned long)(elapsed[i] / 1000), (unsigned long)((elapsed[i] % 1000) / 100),
+           drivePath(opts.dstDrives[i]));
+#else
+  printf("\nDrive  Result        Bytes  Seconds\n");
+  for (i = 0; i < opts.dstCount; i++)
+    printf("  %c:   %-6s  %10lu  %4lu.%lu\n", 'A' + opts.dstDrives[i],
+           ok[i] ? "OK" : "FAILED", (unsigned long)written[i],
+           (unsigned long)(elapsed[i] / 1000), (unsigned long)((elapsed[i] % 1000) / 100));
+#endif
+
+  printf("\nSystem transferred to %d of %d drives.\n", opts.dstCount - failed, opts.dstCount);
+  return failed ? 1 : 0;
 }
@@ -47,11 +47,22 @@
 #include <ctype.h>
 #include <fcntl.h>
 #include <sys/stat.h>
-#include <sys/utime.h>
 #include <string.h>
 
+#ifdef __unix__
+#include <unistd.h>
+#include <utime.h>
+#include <errno.h>
+#include <limits.h>
+#else
+#include <sys/utime.h>
 #include <dos.h>
+#endif
+#ifdef __unix__
+#define SYS_MAXPATH   PATH_MAX  /* as filled by realpath() */
+#else
 #define SYS_MAXPATH   260
+#endif
 #include "portab.h"
 #include "algnbyte.h"
 #include "device.h"
@@ -64,6 +75,15 @@
 #ifndef __WATCOMC__
 #include <direct.h>
 #endif
+#elif defined __unix__
+/* host build (Linux etc.), drives are mapped to host paths (diskio_p.c) */
+#include <stdio.h>
+#include <strings.h>
+#define O_BINARY 0
+#define O_TEXT 0
+#define stricmp strcasecmp
+#define memicmp strncasecmp     /* only used to compare paths */
+
 #else
 /* These definitions deliberately put here instead of
  * #including <stdio.h> to make executable MUCH smaller
@@ -110,10 +130,14 @@ extern DOSBootFiles bootFiles[];
 typedef struct SYSOptions {
   BYTE srcDrive[SYS_MAXPATH];   /* source drive:[path], root assumed if no path */
   BYTE dstDrive;                /* destination drive [STD SYS option] */
+  BYTE dstDrives[26];           /* all destination drives, dstDrives[0] is drive arg */
+  int dstCount;                 /* number of destination drives */
   int flavor;                   /* DOS variant we want to boot, default is AUTO/FD */
   DOSBootFiles kernel;          /* file name(s) and relevant data for kernel */
   BYTE defBootDrive;            /* value stored in boot sector for drive, eg 0x0=A, 0x80=C */
   BOOL ignoreBIOS;              /* true to NOP out boot sector code to get drive# from BIOS */
+  BYTE userBootDrive;           /* defBootDrive and ignoreBIOS as given by user, */
+  int userIgnoreBIOS;           /* before defaults for each destination applied */
   BOOL skipBakBSCopy;           /* true to not copy boot sector to backup boot sector */
   BOOL copyKernel;              /* true to copy kernel files */
   BOOL copyShell;               /* true to copy command interpreter */
@@ -126,11 +150,20 @@ typedef struct SYSOptions {
   BYTE *fnCmd;                  /* optional override to cmd interpreter filename (src & dest) */
   enum {AUTO=0,LBA,CHS} force;  /* optional force boot sector to only use LBA or CHS */
   BOOL verbose;                 /* show extra (DEBUG) output */
+  BOOL contig;                  /* write kernel files to contiguous clusters */
+  BOOL defrag;                  /* move fragmented system files to contiguous clusters */
+  BOOL verify;                  /* read back copied files and compare CRC-32 */
+  BOOL stats;                   /* print I/O statistics at exit */
+  BYTE *traceFile;              /* optional file to log each I/O operation to */
+  enum {COPYALL=0,SAMETIME,SAMECRC} incremental; /* skip files already on drive */
   int bsCount;                  /* how many sectors to read/write */
   
   FileSystem fs;                /* current file system, set based on existing BPB not user option */
   ULONG rootSector;             /* obtained from existing BPB, used for updating root directory */
   UCOUNT rootDirSectors;        /* when booting with OEM boot logic with boot files in 1st entries */
+  BYTE *manifest;               /* optional file listing additional files to copy */
+  BOOL spaceChecked;            /* free space already checked for files being copied */
+  ULONG written;                /* bytes of files copied to current destination */
 } SYSOptions;
 
 /* display how to use and basic help information */
@@ -140,10 +173,12 @@ void showOemHelpAndExit(void);
 
 /* get and validate arguments */
 void initOptions(int argc, char *argv[], SYSOptions *opts);
+/* select destination drive and apply its defaults (boot drive #, etc.) */
+void setDestination(SYSOptions *opts, BYTE drive);
 
 
-/* installs boot sector */
-void put_boot(SYSOptions *opts);
+/* installs boot sector, FALSE if it could not be written */
+BOOL put_boot(SYSOptions *opts);
 
 /* write bs in bsFile to drive's boot record unmodified */
 void restoreBS(SYSOptions *opts);
@@ -152,8 +187,52 @@ void putBS(SYSOptions *opts);
 /* write drive's boot record unmodified to bsFile */
 void dumpBS(SYSOptions *opts);
 
+/* forms full name of filename on drive in dest (SYS_MAXPATH bytes),
+   FALSE (after printing why) if it does not fit */
+BOOL destPath(BYTE *dest, COUNT drive, const BYTE *filename);
+
+/* copy engine tuning, normally left at defaults (varied by benchmark) */
+#define COPY_SIZE       0x4000  /* static buffer used when low on memory */
+#define COPY_BUFFERS    2       /* most ping-pong buffers used */
+extern ULONG copyChunkSize;     /* largest buffer, 0 to size by memory */
+extern int copyBufferCount;     /* buffers filled before draining, 1..COPY_BUFFERS */
+
 /* copies file (path+filename specified by srcFile) to drive:\filename */
-BOOL copy(const BYTE *source, COUNT drive, const BYTE * filename);
+BOOL copy(const BYTE *source, COUNT drive, const BYTE * filename, SYSOptions *opts);
+
+/* copies file to drive:\filename placing it in a single run of free
+   clusters, returns FALSE (without changing disk) if not possible */
+BOOL copyContig(const BYTE *source, COUNT drive, const BYTE * filename, SYSOptions *opts);
+/* moves fragmented kernel and shell files to a single run of clusters,
+   FALSE if a moved file does not verify */
+BOOL defragSystem(SYSOptions *opts, BOOL *moved);
+
+/* when installing to several drives, source files are read only once */
+BOOL cacheSource(const BYTE *source);
+BYTE FAR *cachedSource(const BYTE *source, ULONG *size, ULONG *crc);
+void freeSources(void);
+
+/* returns TRUE if drive has at least bytes free space */
+BOOL check_space(COUNT drive, ULONG bytes);
+/* adjusts free space check_space() has cached for drive after writing
+   bytes to a file replacing one of replaced bytes (0 if new) */
+void spaceUsed(COUNT drive, ULONG bytes, ULONG replaced);
+/* sets FAT32 FSInfo free count and next free cluster to true values */
+BOOL updateFSInfo(COUNT drive, BOOL verbose);
+
+/* copies additional files listed in opts->manifest */
+BOOL copyManifest(SYSOptions *opts);
+
+/* TRUE if incremental mode and drive:\filename already matches source */
+BOOL isUnchanged(const BYTE *source, COUNT drive, const BYTE *filename, SYSOptions *opts);
+
+/* reads back drive:\filename, TRUE if size and CRC-32 match those given */
+BOOL verifyFile(COUNT drive, const BYTE *filename, ULONG size, ULONG crc);
+
+/* returns bytes per second given bytes transferred in elapsed milliseconds */
+ULONG bytesPerSec(ULONG bytes, ULONG ms);
+/* prints size, checksum, and rate of a completed file transfer */
+void printTransferred(ULONG bytes, ULONG crc, ULONG ms);
 
 /* adds basic entry to boot manager configuration file */
 BOOL writeBootLoaderEntry(SYSOptions *opts);
@@ -33,10 +33,17 @@
 void showHelpAndExit(void)
 {
   printf(
+#ifdef __unix__
+      "Usage: %s [source] image [bootsect] [{option}]\n"
+      "  source   = directory with system files, current directory if not given\n"
+      "  image    = FAT formatted disk image file or device, image:N for partition N\n"
+      "  bootsect = name of 512-byte boot sector file image for image\n"
+#else
       "Usage: %s [source] drive: [bootsect] [{option}]\n"
       "  source   = A:,B:,C:\\DOS\\,etc., or current directory if not given\n"
       "  drive    = A,B,etc.\n"
       "  bootsect = name of 512-byte boot sector file image for drive:\n"
+#endif
       "             to write to *instead* of real boot sector\n"
       "  {option} is one or more of the following:\n"
       "  /BOTH    : write to *both* the real boot sector and the image file\n"
@@ -51,10 +58,29 @@ void showHelpAndExit(void)
       "  /K name  : name of kernel to use in boot sector instead of %s\n"
       "  /L segm  : hex load segment to use in boot sector instead of %02x\n"
       "  /B btdrv : hex BIOS # of boot drive set in bs, 0=A:, 80=1st hd,...\n"
+#ifdef __unix__
+      "  /DRIVES list : also install to these images, e.g. /DRIVES b.img,c.img\n"
+      "  /DIRECT  : use direct I/O, bypassing host's cache, for images and devices\n"
+      "  /GEOMETRY heads,sectors : disk geometry for BPB, e.g. /GEOMETRY 255,63\n"
+#else
+      "  /DRIVES list : also install to these drives, e.g. /DRIVES B:D:E:\n"
+#endif
+      "  /MANIFEST file : also copy files listed in file, one source [dest] per line\n"
       "  /FORCE   : override automatic selection of BIOS related settings\n"
       "             /FORCE:BSDRV use boot drive # set in bootsector\n"
       "             /FORCE:BIOSDRV use boot drive # provided by BIOS\n"
       "  /NOBAKBS : skips copying boot sector to backup bs, FAT32 only else ignored\n"
+      "  /INCR    : skip files whose size and time match, and unchanged boot sector\n"
+      "             /INCR:CRC compare size and contents (CRC-32) instead of time\n"
+      "  /VERIFY  : read back copied files and compare CRC-32 checksums\n"
+#ifdef WITHCONTIG
+      "  /CONTIG  : write kernel files to contiguous clusters for faster booting\n"
+      "  /DEFRAG  : move fragmented kernel and shell files to contiguous clusters\n"
+#endif
+#ifdef WITHSTATS
+      "  /STATS   : show counts and time taken of disk and file operations\n"
+      "  /TRACE file : log each disk and file operation to file\n"
+#endif
       "  /HELP    : display this usage screen and exit\n"
 #ifdef FDCONFIG
       "Usage: %s CONFIG /HELP\n"